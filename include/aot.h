@@ -0,0 +1,43 @@
+#ifndef CHIP8_AOT_H
+#define CHIP8_AOT_H
+
+#include "common.h"
+#include "cpu.h"
+
+/// ROM compiled ahead of time by chip8_aot, load_program picks the
+/// registered program whose image matches the loaded ROM
+struct AotProgram {
+    /// entry point into a compiled basic block, one per instruction
+    struct Block {
+        /// entry address
+        word addr;
+        /// bytes of ram from addr to the end of the block
+        word size;
+        /// decode cache handler running the block from nnn
+        void (*exec)(Cpu &cpu, const Instruction &ins);
+    };
+
+    /// ROM file name the program was compiled from
+    const char *name;
+    /// load address of image
+    word origin;
+    /// ROM contents
+    const byte *image;
+    size_t image_size;
+    /// entry points sorted by address
+    const Block *blocks;
+    size_t block_count;
+    /// largest block size in bytes
+    size_t max_block_size;
+
+    /// entry point at addr, null if there is none or ram no longer holds
+    /// the code it was compiled from
+    const Block *lookup(size_t addr, const byte *ram) const;
+
+    /// register a program, called by generated code at startup
+    static bool add(const AotProgram &program);
+    /// registered program for a ROM image, null if none
+    static const AotProgram *find(const byte *image, size_t size);
+};
+
+#endif
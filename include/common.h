@@ -1,9 +1,10 @@
-#ifndef CHIP8_COMMON_H
-#define CHIP8_COMMON_H
-
-#include <cstdint>
-
-using byte = std::uint8_t;
-using word = std::uint16_t;
-
-#endif
+#ifndef CHIP8_COMMON_H
+#define CHIP8_COMMON_H
+
+#include <cstddef>
+#include <cstdint>
+
+using byte = std::uint8_t;
+using word = std::uint16_t;
+
+#endif
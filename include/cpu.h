@@ -1,97 +1,373 @@
-#ifndef CHIP8_CPU_H
-#define CHIP8_CPU_H
-
-#include "common.h"
-
-class Cpu {
-public:
-    /// memory size
-    static constexpr size_t mem_size = 4096;
-    /// stack size
-    static constexpr size_t stack_size = 16;
-    /// video ram width
-    static constexpr size_t vram_width = 64;
-    /// video ram height
-    static constexpr size_t vram_height = 32;
-    /// video ram size
-    static constexpr size_t vram_size = (vram_width * vram_height);
-    /// number of keys
-    static constexpr size_t key_size = 16;
-    /// font sprite size
-    static constexpr size_t sprint_size = 5;
-
-private:
-    /// cpu register struct
-    struct Register {
-        /// program counter
-        word pc;
-        /// stack pointer
-        byte sp;
-
-        /// 16 bytes v-registers, last one is flag register
-        union {
-            byte v[16];
-            struct {
-                byte __[15];
-                byte v_flag;
-            };
-        };
-
-        /// register I
-        word i;
-    };
-
-    /// cpu register
-    Register reg;
-
-    /// main memory
-    byte ram[mem_size];
-    /// video memory
-    byte vram[vram_size];
-    /// stack
-    word stack[stack_size];
-    /// keyboard
-    bool keys[key_size];
-
-    /// delay timer
-    byte delay_timer;
-    /// sound timer
-    byte sound_timer;
-
-    /// flag indicating gui update
-    bool update_gui;
-    /// debug flag
-    bool debug;
-
-    /// cpu ticks
-    uint32_t last_cpu_ticks;
-    /// timer ticks
-    uint32_t last_timer_ticks;
-
-    /// fetch opcode
-    word fetch();
-    /// print registers
-    void dump_registers();
-
-    friend class Operations;
-
-public:
-    /// run one cycle
-    void cycle(uint32_t cycles);
-    /// interrupt opcode
-    void interpret(word opcode);
-    /// reset register and memory
-    void reset();
-    
-    /// load program from file
-    void load_program(const char *file);
-    /// set debug mode (print internal state)
-    void set_debug(bool debug) { this->debug = debug; }
-
-    /// get video buffer
-    byte* get_vram() { return this->vram; }
-    /// get key buffer
-    bool* get_keys() { return this->keys; }
-};
-
-#endif
+#ifndef CHIP8_CPU_H
+#define CHIP8_CPU_H
+
+#include "common.h"
+#include "random.h"
+#include "trace.h"
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+class Cpu;
+class Jit;
+class Debugger;
+class Profiler;
+class TraceRing;
+struct AotProgram;
+struct RomImage;
+
+/// pre-decoded instruction
+struct Instruction {
+    /// handler in Operations
+    void (*exec)(Cpu &cpu, const Instruction &ins);
+    /// address / 12 bits value (nnn)
+    word nnn;
+    /// register x
+    byte x;
+    /// register y
+    byte y;
+    /// 8 bits value (kk)
+    byte kk;
+    /// 4 bits value (n)
+    byte n;
+    /// 8 bits value of the second instruction of a fused pair
+    byte kk2;
+};
+
+class Cpu {
+public:
+    /// memory size
+    static constexpr size_t mem_size = 4096;
+    /// stack size
+    static constexpr size_t stack_size = 16;
+    /// video ram width
+    static constexpr size_t vram_width = 64;
+    /// video ram height
+    static constexpr size_t vram_height = 32;
+    /// video ram size
+    static constexpr size_t vram_size = (vram_width * vram_height);
+    static_assert(vram_width == 64 && vram_height <= 32, "vram rows are packed in words");
+    /// number of keys
+    static constexpr size_t key_size = 16;
+    /// font sprite size
+    static constexpr size_t sprint_size = 5;
+    /// max bytes a decoded instruction depends on (idle loops, fused pairs)
+    static constexpr size_t max_decode_span = 6;
+    /// memory is copied on write in pages of this many bytes
+    static constexpr size_t page_bits = 8;
+    static constexpr size_t page_size = 1 << page_bits;
+    static constexpr size_t page_count = mem_size / page_size;
+    /// save state format version
+    static constexpr uint16_t state_version = 2;
+    /// save state size in bytes
+    static const size_t state_size;
+    /// timer frequency, one frame per timer tick
+    static constexpr uint32_t frame_rate = 60;
+    /// default instructions per timer tick (600Hz cpu, 60Hz timers)
+    static constexpr uint32_t default_timer_ratio = 10;
+
+    /// cpu register struct
+    struct Register {
+        /// program counter
+        word pc;
+        /// stack pointer
+        byte sp;
+
+        /// 16 bytes v-registers, last one is flag register
+        union {
+            byte v[16];
+            struct {
+                byte __[15];
+                byte v_flag;
+            };
+        };
+
+        /// register I
+        word i;
+    };
+
+private:
+    /// cpu register
+    Register reg;
+
+    /// one page of main memory and its decode cache
+    struct Page {
+        /// page_size bytes, the image's until the guest writes the page
+        const byte *ram;
+        /// one entry per even address, the image's while they decode the
+        /// same for this cpu
+        const Instruction *decoded;
+    };
+
+    /// loaded ROM, pages point into it
+    std::shared_ptr<const RomImage> image;
+    /// main memory and decode cache by page
+    Page pages[page_count];
+    /// private pages, allocated on first write and kept across resets
+    std::unique_ptr<byte[]> own_ram[page_count];
+    std::unique_ptr<Instruction[]> own_decoded[page_count];
+    /// decode cache of the page executed last, saves the page table load
+    /// while pc stays in it; page_count after any page is remapped
+    size_t current_page = page_count;
+    const Instruction *current_decoded = nullptr;
+
+    /// video memory, one row per word, leftmost pixel in the highest bit
+    uint64_t vram[vram_height];
+    /// stack
+    word stack[stack_size];
+    /// keyboard
+    bool keys[key_size];
+
+    /// delay timer
+    byte delay_timer;
+    /// sound timer
+    byte sound_timer;
+
+    /// random generator for CXNN, reseeded with seed on reset
+    Random rng;
+    uint64_t seed = 0;
+
+    /// video rows changed since last take_dirty_rows, one bit per row
+    uint32_t dirty_rows;
+    /// video rows and memory pages changed since the last state_hash,
+    /// whose cached hashes are stale
+    uint32_t hash_rows;
+    uint16_t hash_pages;
+    /// cached StateHash of video memory and of each memory page
+    uint64_t vram_hash;
+    uint64_t page_hashes[page_count];
+    /// debug flag
+    bool debug = false;
+
+    /// executed instructions
+    uint64_t instructions;
+    /// instructions per timer tick, when timed by instruction count
+    uint32_t timer_ratio = default_timer_ratio;
+    /// instructions left until next timer tick
+    uint32_t timer_countdown;
+    /// instructions left in current slice
+    uint32_t budget;
+
+    /// fetch opcode
+    word fetch();
+    /// byte at addr, wrapped to memory size
+    byte read(size_t addr) const {
+        addr &= mem_size - 1;
+        return pages[addr >> page_bits].ram[addr & (page_size - 1)];
+    }
+    /// copy len bytes from addr on to out, addresses wrap to memory size
+    void load(size_t addr, byte *out, size_t len) const {
+        while (len > 0) {
+            addr &= mem_size - 1;
+            size_t offset = addr & (page_size - 1);
+            size_t chunk = std::min(len, page_size - offset);
+            const byte *from = pages[addr >> page_bits].ram + offset;
+            for (size_t k = 0; k < chunk; k++) {
+                out[k] = from[k];
+            }
+            addr += chunk;
+            out += chunk;
+            len -= chunk;
+        }
+    }
+    /// store len bytes from addr on, addresses wrap to memory size,
+    /// decoded instructions depending on them are dropped
+    void store(size_t addr, const byte *data, size_t len) {
+        while (len > 0) {
+            addr &= mem_size - 1;
+            size_t offset = addr & (page_size - 1);
+            size_t chunk = std::min(len, page_size - offset);
+            byte *to = own_page(addr >> page_bits) + offset;
+            hash_pages |= 1 << (addr >> page_bits);
+            invalidate(addr, chunk);
+            for (size_t k = 0; k < chunk; k++) {
+                to[k] = data[k];
+            }
+            addr += chunk;
+            data += chunk;
+            len -= chunk;
+        }
+    }
+    /// private copy of a memory page, made on first write
+    byte *own_page(size_t page) {
+        byte *own = own_ram[page].get();
+        if (pages[page].ram != own)
+            own = copy_page(page);
+        return own;
+    }
+    byte *copy_page(size_t page);
+    /// decode cache entry at even addr, through the current page
+    const Instruction &current_entry(size_t addr) {
+        size_t page = addr >> page_bits;
+        if (page != current_page) {
+            current_page = page;
+            current_decoded = pages[page].decoded;
+        }
+        return current_decoded[(addr & (page_size - 1)) >> 1];
+    }
+    /// point a page at a decode cache
+    void map_page(size_t page, const Instruction *decoded) {
+        pages[page].decoded = decoded;
+        current_page = page_count;
+    }
+    /// writable decode cache entry at even addr, its page's entries are
+    /// copied first if they are the image's
+    Instruction &own_entry(size_t addr);
+    /// private decode cache of a page, copied from the current one if copy
+    Instruction *own_decoded_page(size_t page, bool copy);
+    /// point pages at the image's decode cache where they decode the same
+    /// for this cpu, the other pages get private caches of misses
+    void map_decoded();
+    /// execute instruction at pc
+    template <typename Trace>
+    void step();
+    /// execute instructions until budget runs out or the debugger stops
+    template <typename Trace>
+    void run_slice();
+    /// slice function and decode cache miss handler of the tracing policy,
+    /// picked by select_policy
+    void (Cpu::*run_fn)() = &Cpu::run_slice<NoTrace>;
+    void (*decode_miss)(Cpu &cpu, const Instruction &ins);
+    /// pick the policy for debug, debugger, profiler and trace, then drop
+    /// cached handlers
+    void select_policy();
+
+    /// breakpoints and watchpoints, null when not debugging
+    Debugger *debugger = nullptr;
+    /// execution counts, null when not profiling
+    Profiler *profiler = nullptr;
+    /// last executed instructions, null when not tracing
+    TraceRing *trace = nullptr;
+
+    /// native code translator, null when disabled
+    std::unique_ptr<Jit> jit;
+    /// ahead-of-time compiled ROM, null when none
+    const AotProgram *aot = nullptr;
+    /// decrease delay and sound timer
+    void tick_timers();
+    /// bytes after an address the entry decoded there may depend on
+    size_t decode_span() const;
+    /// drop decoded instructions overlapping ram[addr, addr + len),
+    /// addresses wrap to memory size
+    void invalidate(size_t addr, size_t len);
+
+    friend class Operations;
+
+public:
+    Cpu();
+    ~Cpu();
+
+    Cpu(const Cpu &) = delete;
+    Cpu &operator=(const Cpu &) = delete;
+
+    /// result of run_frame
+    struct Frame {
+        /// instructions executed
+        uint32_t instructions;
+        /// video rows changed, bit n for row n
+        uint32_t dirty_rows;
+        /// sound timer active
+        bool sound;
+    };
+
+    /// run instructions up to the next timer tick, then tick timers
+    Frame run_frame();
+    /// run instructions uncapped, timers tick every timer_ratio instructions;
+    /// returns early while the debugger is stopped. When an instruction
+    /// throws, the ones before it are counted and it is not
+    void run(uint64_t count);
+    /// interrupt opcode
+    void interpret(word opcode);
+    /// reset register and memory
+    void reset();
+    
+    /// load program from file, picks a registered compiled program for it
+    void load_program(const char *file);
+    /// load program from memory, throws if it does not fit
+    void load_program(const byte *program, size_t size);
+    /// run a shared ROM image, cheap as memory is copied only where the
+    /// program writes it
+    void load_program(std::shared_ptr<const RomImage> image);
+    /// get loaded ROM image
+    const std::shared_ptr<const RomImage> &get_image() const { return this->image; }
+    /// set debug mode (print internal state)
+    void set_debug(bool debug);
+    /// stop at breakpoints and watchpoints of debugger (not owned), null
+    /// runs at full speed again, debug takes precedence
+    void set_debugger(Debugger *debugger);
+    /// get debugger in use
+    Debugger *get_debugger() const { return this->debugger; }
+    /// count executions in profiler (not owned), null stops profiling,
+    /// debug and debugger take precedence
+    void set_profiler(Profiler *profiler);
+    /// record executed instructions in trace (not owned), null stops
+    /// tracing, debug, debugger and profiler take precedence
+    void set_trace(TraceRing *trace);
+    /// translate straight-line code to native code (x86-64 only, throws
+    /// elsewhere), tracing takes precedence while debug is set
+    void set_jit(bool enable);
+    /// run blocks of a compiled program where ram still holds its code,
+    /// null runs the interpreter only
+    void set_aot(const AotProgram *program);
+    /// get compiled program in use
+    const AotProgram *get_aot() const { return this->aot; }
+    /// seed CXNN's generator now and on every reset, equal seeds give
+    /// equal runs
+    void set_seed(uint64_t seed);
+    /// get seed of CXNN's generator
+    uint64_t get_seed() const { return this->seed; }
+    /// set instructions per timer tick used by run, a frame that has not
+    /// started yet (after reset or load) takes the new length
+    void set_timer_ratio(uint32_t ratio);
+    /// get instructions per timer tick
+    uint32_t get_timer_ratio() const { return this->timer_ratio; }
+
+    /// write a save state of state_size bytes, in host byte order
+    void save_state(byte *out) const;
+    std::vector<byte> save_state() const;
+    /// restore a save state, throws if it is not a valid state; one of the
+    /// right size and version holding impossible registers or timers
+    /// leaves the cpu reset, with its timer ratio
+    void load_state(const byte *data, size_t size);
+    void load_state(const std::vector<byte> &state) { load_state(state.data(), state.size()); }
+
+    /// print registers
+    void dump_registers();
+
+    /// expand a video row to one value per pixel, leftmost pixel first
+    template <typename T>
+    static void expand_row(uint64_t row, T *pixels, T on, T off) {
+        for (size_t x = 0; x < vram_width; x++) {
+            pixels[x] = (row >> (vram_width - 1 - x)) & 1 ? on : off;
+        }
+    }
+
+    /// get executed instruction count
+    uint64_t get_instructions() const { return this->instructions; }
+
+    /// copy memory to out, mem_size bytes
+    void copy_ram(byte *out) const;
+    /// memory holding ram[addr, addr + len) at those offsets, for decoding,
+    /// valid until the next call on this thread
+    const byte *view(size_t addr, size_t len) const;
+    /// get video buffer, one row per word
+    const uint64_t* get_vram() const { return this->vram; }
+    /// get and clear the changed video rows, bit n for row n
+    uint32_t take_dirty_rows() {
+        uint32_t rows = dirty_rows;
+        dirty_rows = 0;
+        return rows;
+    }
+    /// hash of everything the next instructions depend on besides keys:
+    /// memory, video memory, registers, live stack entries, timers and the
+    /// CXNN generator. Only what changed since the last call is hashed
+    /// again. Equal states give equal hashes, different ones collide with
+    /// about 2^-64 probability
+    uint64_t state_hash();
+    /// get key buffer
+    bool* get_keys() { return this->keys; }
+    /// get registers
+    const Register& get_registers() const { return this->reg; }
+};
+
+#endif
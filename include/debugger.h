@@ -0,0 +1,114 @@
+#ifndef CHIP8_DEBUGGER_H
+#define CHIP8_DEBUGGER_H
+
+#include "common.h"
+#include "cpu.h"
+#include <bitset>
+#include <cstdio>
+#include <vector>
+
+/// breakpoints and memory watchpoints of a Cpu (Cpu::set_debugger). A hit
+/// stops Cpu::run early until resume; cpus without a debugger run the
+/// uninstrumented interpreter
+class Debugger {
+public:
+    /// register index of I in conditions, V0-VF are 0-15
+    static constexpr byte reg_i = 16;
+
+    enum Compare { equal, not_equal, less, greater };
+
+    /// memory access kinds, watchpoints take a mask of them
+    enum Access { read = 1, write = 2 };
+
+    /// stop before the instruction at addr runs, if the condition holds
+    struct Breakpoint {
+        word addr;
+        bool conditional;
+        byte reg;
+        Compare compare;
+        word value;
+    };
+
+    /// stop after an instruction accessed memory in [addr, addr + length)
+    struct Watchpoint {
+        word addr;
+        word length;
+        unsigned access;
+    };
+
+    /// why the cpu stopped
+    struct Hit {
+        enum Kind { breakpoint, read, write } kind;
+        /// breakpoint or watchpoint index
+        size_t index;
+        /// address of the instruction
+        word pc;
+        /// first accessed address matching the watchpoint, pc for breakpoints
+        word addr;
+    };
+
+    /// add a breakpoint, returns its index
+    size_t add_breakpoint(word addr);
+    size_t add_breakpoint(word addr, byte reg, Compare compare, word value);
+    /// add a watchpoint on length bytes from addr (wrapping at the end of
+    /// memory), access is a mask of Access, returns its index
+    size_t add_watchpoint(word addr, word length, unsigned access);
+    /// add from command line text, ADDR or ADDR:REG==VALUE (REG V0-VF or I,
+    /// also != < >) for breakpoints, ADDR[:LENGTH][:r|w|rw] for
+    /// watchpoints; throws if it does not parse
+    size_t add_breakpoint(const char *spec);
+    size_t add_watchpoint(const char *spec);
+    /// remove all breakpoints and watchpoints
+    void clear();
+
+    const std::vector<Breakpoint> &get_breakpoints() const { return this->breakpoints; }
+    const std::vector<Watchpoint> &get_watchpoints() const { return this->watchpoints; }
+
+    /// a hit is pending, the cpu does not run until resume
+    bool stopped() const { return this->has_hit; }
+    /// the pending hit
+    const Hit &get_hit() const { return this->hit; }
+    /// drop the pending hit, the cpu runs on from where it stopped
+    void resume();
+
+    /// print the pending hit, e.g. "write 0x0300 by 0x0246 (watch 0)"
+    void print_hit(FILE *out) const;
+
+    /// called by the cpu before it runs the instruction at pc, true if a
+    /// breakpoint stops it there
+    bool check_break(const Cpu::Register &reg) {
+        word pc = reg.pc & (Cpu::mem_size - 1);
+        if (!armed[pc])
+            return false;
+        if (skip_armed) {
+            skip_armed = false;
+            if (pc == skip_pc)
+                return false;
+        }
+        return check_conditions(reg, pc);
+    }
+    /// called by handlers after the instruction at pc - 2 accessed length
+    /// bytes from addr
+    void check_access(const Cpu::Register &reg, size_t addr, size_t length, Access access) {
+        if (!watchpoints.empty() && !has_hit)
+            check_watchpoints(reg, addr, length, access);
+    }
+
+private:
+    std::vector<Breakpoint> breakpoints;
+    std::vector<Watchpoint> watchpoints;
+    /// addresses with a breakpoint
+    std::bitset<Cpu::mem_size> armed;
+
+    bool has_hit = false;
+    Hit hit;
+    /// let the instruction stopped at by a breakpoint run once on resume
+    bool skip_armed = false;
+    word skip_pc = 0;
+
+    size_t add(const Breakpoint &breakpoint);
+    bool check_conditions(const Cpu::Register &reg, word pc);
+    void check_watchpoints(const Cpu::Register &reg, size_t addr, size_t length, Access access);
+};
+
+#endif
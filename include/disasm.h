@@ -0,0 +1,78 @@
+#ifndef CHIP8_DISASM_H
+#define CHIP8_DISASM_H
+
+#include "common.h"
+#include <cstdio>
+#include <string>
+
+/// mnemonic of an opcode in the syntax of the debug trace, empty if the
+/// opcode is invalid
+inline std::string disassemble(word opcode) {
+    unsigned nnn = opcode & 0x0fff;
+    unsigned x = (opcode & 0x0f00) >> 8;
+    unsigned y = (opcode & 0x00f0) >> 4;
+    unsigned kk = opcode & 0x00ff;
+    unsigned n = opcode & 0x000f;
+
+    char text[32] = {};
+    switch (opcode >> 12) {
+        case 0x00:
+            if (kk == 0xe0)
+                return "CLS";
+            if (kk == 0xee)
+                return "RET";
+            snprintf(text, sizeof(text), "SYS  0x%04X", nnn);
+            break;
+        case 0x01: snprintf(text, sizeof(text), "JP   0x%04X", nnn); break;
+        case 0x02: snprintf(text, sizeof(text), "CALL 0x%04X", nnn); break;
+        case 0x03: snprintf(text, sizeof(text), "SE   V%X, 0x%04X", x, kk); break;
+        case 0x04: snprintf(text, sizeof(text), "SNE  V%X, 0x%04X", x, kk); break;
+        case 0x05:
+            if (n)
+                return "";
+            snprintf(text, sizeof(text), "SE   V%X, V%X", x, y);
+            break;
+        case 0x06: snprintf(text, sizeof(text), "LD   V%X, 0x%04X", x, kk); break;
+        case 0x07: snprintf(text, sizeof(text), "ADD  V%X, 0x%04X", x, kk); break;
+        case 0x08: {
+            static const char *names[16] = {
+                "LD  ", "OR  ", "AND ", "XOR ", "ADD ", "SUB ", "SHR ", "SUBN",
+                nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, "SHL ", nullptr,
+            };
+            if (!names[n])
+                return "";
+            snprintf(text, sizeof(text), "%s V%X, V%X", names[n], x, y);
+            break;
+        }
+        case 0x09: snprintf(text, sizeof(text), "SNE  V%X, V%X", x, y); break;
+        case 0x0a: snprintf(text, sizeof(text), "LD   I,  0x%04X", nnn); break;
+        case 0x0b: snprintf(text, sizeof(text), "JP   V0, 0x%04X", nnn); break;
+        case 0x0c: snprintf(text, sizeof(text), "RND  V%X, 0x%04X", x, kk); break;
+        case 0x0d: snprintf(text, sizeof(text), "DRW  V%X, V%X, 0x%X", x, y, n); break;
+        case 0x0e:
+            if (kk == 0x9e)
+                snprintf(text, sizeof(text), "SKP  V%X", x);
+            else if (kk == 0xa1)
+                snprintf(text, sizeof(text), "SKNP V%X", x);
+            else
+                return "";
+            break;
+        case 0x0f:
+            switch (kk) {
+                case 0x07: snprintf(text, sizeof(text), "LD   V%X, DT", x); break;
+                case 0x0a: snprintf(text, sizeof(text), "LD   V%X, KEY", x); break;
+                case 0x15: snprintf(text, sizeof(text), "LD   DT, V%X", x); break;
+                case 0x18: snprintf(text, sizeof(text), "LD   ST, V%X", x); break;
+                case 0x1e: snprintf(text, sizeof(text), "ADD  I,  V%X", x); break;
+                case 0x29: snprintf(text, sizeof(text), "LD   F, V%X", x); break;
+                case 0x33: snprintf(text, sizeof(text), "LD BCD,  V%X", x); break;
+                case 0x55: snprintf(text, sizeof(text), "LD   [I], V%X", x); break;
+                case 0x65: snprintf(text, sizeof(text), "LD   V%X, [I]", x); break;
+                default: return "";
+            }
+            break;
+    }
+    return text;
+}
+
+#endif
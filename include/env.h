@@ -0,0 +1,104 @@
+#ifndef CHIP8_ENV_H
+#define CHIP8_ENV_H
+
+#include "common.h"
+#include "cpu.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+template <size_t Lanes>
+class Lockstep;
+class ThreadPool;
+struct RomImage;
+
+/// many instances of one ROM stepped together for reinforcement learning,
+/// reset and step write the screens of all instances into one buffer owned
+/// by the caller. A step holds the action keys for frame_skip frames of
+/// timer_ratio instructions. An instance that fails or reaches max_frames
+/// ends its episode and restarts at once, its observation is then the
+/// first one of the new episode
+class VectorEnv {
+public:
+    /// instances per Lockstep
+    static constexpr size_t lanes = 16;
+
+    /// observation layout of one instance
+    enum class Observation {
+        /// vram_height rows as uint64_t in host byte order, leftmost pixel
+        /// in the highest bit
+        packed,
+        /// vram_size bytes, 1 for lit pixels, 0 for dark ones, row by row
+        pixels,
+    };
+
+    struct Config {
+        /// number of instances
+        size_t count = 1;
+        /// frames per step, keys are held for all of them
+        uint32_t frame_skip = 4;
+        /// instructions per frame
+        uint32_t timer_ratio = Cpu::default_timer_ratio;
+        /// CXNN seed of instance n in episode e is seed + n + e * count
+        uint64_t seed = 0;
+        /// frames after which an episode ends, 0 for no limit
+        uint64_t max_frames = 0;
+        Observation observation = Observation::packed;
+        /// worker threads stepping instances, 1 steps them on the caller
+        size_t threads = 1;
+    };
+
+    /// throws if the ROM can not be loaded or config is invalid
+    VectorEnv(const char *rom, const Config &config);
+    /// every instance runs the same shared image, throws if config is
+    /// invalid
+    VectorEnv(std::shared_ptr<const RomImage> rom, const Config &config);
+    ~VectorEnv();
+
+    VectorEnv(const VectorEnv &) = delete;
+    VectorEnv &operator=(const VectorEnv &) = delete;
+
+    /// number of instances
+    size_t size() const { return config.count; }
+    /// observation bytes of one instance, instance n is written at
+    /// observations + n * observation_size()
+    size_t observation_size() const;
+
+    /// restart every instance and write their observations
+    void reset(byte *observations);
+    /// hold actions[n] (bit k for key k) on instance n for frame_skip
+    /// frames, then write observations; done[n] is set to 1 if the episode
+    /// of instance n ended, else 0. done may be null
+    void step(const uint16_t *actions, byte *observations, byte *done = nullptr);
+
+    /// frames of the running episode of an instance
+    uint64_t get_frames(size_t env) const { return frames[env]; }
+    /// episodes an instance ended so far
+    uint64_t get_episodes(size_t env) const { return episodes[env]; }
+    /// why the last episode of an instance ended early, empty if it did not
+    /// fail
+    const std::string &get_error(size_t env) const { return errors[env]; }
+    /// get memory of an instance, mem_size bytes, e.g. to read a score
+    const byte *get_ram(size_t env) const;
+    /// get sound timer of an instance
+    byte get_sound_timer(size_t env) const;
+
+private:
+    Config config;
+    std::vector<std::unique_ptr<Lockstep<lanes>>> blocks;
+    /// null when stepping on the caller
+    std::unique_ptr<ThreadPool> pool;
+
+    std::vector<uint64_t> frames;
+    std::vector<uint64_t> episodes;
+    std::vector<std::string> errors;
+
+    /// start a new episode of an instance
+    void restart(size_t env);
+    /// write the observation of an instance
+    void observe(size_t env, byte *out) const;
+    /// step the instances of blocks [first, last)
+    void step_blocks(size_t first, size_t last, const uint16_t *actions, byte *observations, byte *done);
+};
+
+#endif
@@ -1,110 +1,147 @@
-#ifndef CHIP8_GUI_H
-#define CHIP8_GUI_H
-
-#include "common.h"
-#include <SDL2/SDL.h>
-#include <stdexcept>
-
-#define COLOR_BLACK 0x00'00'00'00
-#define COLOR_MONOCHROME 0x00'00'79'39
-
-/// mapping 16 chip8 keys
-constexpr byte key_mapping[] = {
-    SDL_SCANCODE_1, SDL_SCANCODE_2, SDL_SCANCODE_3, SDL_SCANCODE_4,
-    SDL_SCANCODE_Q, SDL_SCANCODE_W, SDL_SCANCODE_E, SDL_SCANCODE_R,
-    SDL_SCANCODE_A, SDL_SCANCODE_S, SDL_SCANCODE_D, SDL_SCANCODE_F,
-    SDL_SCANCODE_Z, SDL_SCANCODE_X, SDL_SCANCODE_C, SDL_SCANCODE_V
-};
-
-class Gui {
-public:
-    Gui(int width, int height, int pixel_size)
-        : width(width), height(height), pixel_size(pixel_size)
-    {
-        init();
-    }
-
-    ~Gui() {
-        if (window)
-            SDL_DestroyWindow(window);
-
-        SDL_Quit();
-    }
-
-    /// clear screen
-    void clear() {
-        SDL_FillRect(surface, NULL, COLOR_BLACK);
-        SDL_UpdateWindowSurface(window);
-    }
-
-    /// update screen with video ram data
-    void update_screen(byte *vram) {
-        SDL_Rect rect;
-        rect.h = pixel_size;
-        rect.w = pixel_size;
-
-        for (int i = 0; i < height; i++) {
-            rect.y = i * pixel_size;
-            rect.x = 0;
-            for (int j = 0; j < width; j++) {
-                if (vram[width * i + j]) {
-                    SDL_FillRect(surface, &rect, COLOR_MONOCHROME);
-                } else {
-                    SDL_FillRect(surface, &rect, COLOR_BLACK);
-                }
-                rect.x += pixel_size;
-            }
-        }
-
-        SDL_UpdateWindowSurface(window);
-    }
-
-    /// update key buffer
-    void update_keys(bool *keys) {
-        const Uint8 *state = SDL_GetKeyboardState(NULL);
-        for (byte i = 0; i < sizeof(key_mapping); i++) {
-            keys[i] = state[key_mapping[i]] == 1;
-        }
-    }
-
-    /// get ticks from program startup
-    uint32_t get_ticks() {
-        return SDL_GetTicks();
-    }
-
-    /// poll SDL events, return true if should quit
-    bool should_quit() {
-        SDL_Event event;
-        while (SDL_PollEvent(&event)) {
-            if (event.type == SDL_QUIT) {
-                return true;
-            }
-        }
-        return false;
-    }
-
-private:
-    int width;
-    int height;
-    int pixel_size;
-
-    SDL_Window *window;
-    SDL_Surface *surface;
-
-    /// intialize SDL context and window
-    void init() {
-        if (SDL_Init(SDL_INIT_VIDEO) < 0) {
-            throw std::runtime_error("initialize sdl failed");
-        }
-
-        window = SDL_CreateWindow("CHIP8", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
-            width * pixel_size, height * pixel_size, SDL_WINDOW_SHOWN);
-        if (!window) {
-            throw std::runtime_error("create sdl window failed");
-        }
-
-        surface = SDL_GetWindowSurface(window);
-    }
-};
-
-#endif
+#ifndef CHIP8_GUI_H
+#define CHIP8_GUI_H
+
+#include "common.h"
+#include "cpu.h"
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#define COLOR_BLACK 0xff'00'00'00
+#define COLOR_MONOCHROME 0xff'00'79'39
+
+/// mapping 16 chip8 keys
+constexpr byte key_mapping[] = {
+    SDL_SCANCODE_1, SDL_SCANCODE_2, SDL_SCANCODE_3, SDL_SCANCODE_4,
+    SDL_SCANCODE_Q, SDL_SCANCODE_W, SDL_SCANCODE_E, SDL_SCANCODE_R,
+    SDL_SCANCODE_A, SDL_SCANCODE_S, SDL_SCANCODE_D, SDL_SCANCODE_F,
+    SDL_SCANCODE_Z, SDL_SCANCODE_X, SDL_SCANCODE_C, SDL_SCANCODE_V
+};
+
+class Gui {
+public:
+    Gui(int width, int height, int pixel_size)
+        : width(width), height(height), pixel_size(pixel_size),
+          pixels(width * height, COLOR_BLACK)
+    {
+        init();
+    }
+
+    ~Gui() {
+        if (texture)
+            SDL_DestroyTexture(texture);
+        if (renderer)
+            SDL_DestroyRenderer(renderer);
+        if (window)
+            SDL_DestroyWindow(window);
+
+        SDL_Quit();
+    }
+
+    /// clear screen
+    void clear() {
+        std::fill(pixels.begin(), pixels.end(), COLOR_BLACK);
+        SDL_UpdateTexture(texture, NULL, pixels.data(), width * sizeof(Uint32));
+        present();
+    }
+
+    /// upload changed rows of video ram (bit n for row n) and show them
+    void update_screen(const uint64_t *vram, uint32_t dirty_rows) {
+        if (!dirty_rows)
+            return;
+
+        int first = __builtin_ctz(dirty_rows);
+        int last = 31 - __builtin_clz(dirty_rows);
+        if (last >= height)
+            last = height - 1;
+
+        for (int i = first; i <= last; i++) {
+            if (dirty_rows & (1u << i))
+                Cpu::expand_row<Uint32>(vram[i], &pixels[i * width], COLOR_MONOCHROME, COLOR_BLACK);
+        }
+
+        SDL_Rect rect = { 0, first, width, last - first + 1 };
+        SDL_UpdateTexture(texture, &rect, &pixels[first * width], width * sizeof(Uint32));
+        present();
+    }
+
+    /// pressed keys, bit n for key n
+    uint16_t get_keys() {
+        const Uint8 *state = SDL_GetKeyboardState(NULL);
+        uint16_t keys = 0;
+        for (byte i = 0; i < sizeof(key_mapping); i++) {
+            keys |= uint16_t(state[key_mapping[i]] == 1) << i;
+        }
+        return keys;
+    }
+
+    /// rewind key held
+    bool rewind_pressed() {
+        return SDL_GetKeyboardState(NULL)[SDL_SCANCODE_BACKSPACE] == 1;
+    }
+
+    /// get ticks from program startup
+    uint32_t get_ticks() {
+        return SDL_GetTicks();
+    }
+
+    /// poll SDL events, return true if should quit
+    bool should_quit() {
+        SDL_Event event;
+        while (SDL_PollEvent(&event)) {
+            if (event.type == SDL_QUIT) {
+                return true;
+            }
+            if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_EXPOSED) {
+                present();
+            }
+        }
+        return false;
+    }
+
+private:
+    int width;
+    int height;
+    int pixel_size;
+
+    SDL_Window *window = nullptr;
+    SDL_Renderer *renderer = nullptr;
+    /// screen sized texture, scaled up by the renderer
+    SDL_Texture *texture = nullptr;
+    /// host copy of texture pixels
+    std::vector<Uint32> pixels;
+
+    /// draw texture to the whole window
+    void present() {
+        SDL_RenderClear(renderer);
+        SDL_RenderCopy(renderer, texture, NULL, NULL);
+        SDL_RenderPresent(renderer);
+    }
+
+    /// intialize SDL context and window
+    void init() {
+        if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+            throw std::runtime_error("initialize sdl failed");
+        }
+
+        window = SDL_CreateWindow("CHIP8", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+            width * pixel_size, height * pixel_size, SDL_WINDOW_SHOWN);
+        if (!window) {
+            throw std::runtime_error("create sdl window failed");
+        }
+
+        renderer = SDL_CreateRenderer(window, -1, 0);
+        if (!renderer) {
+            throw std::runtime_error("create sdl renderer failed");
+        }
+
+        texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+            SDL_TEXTUREACCESS_STREAMING, width, height);
+        if (!texture) {
+            throw std::runtime_error("create sdl texture failed");
+        }
+    }
+};
+
+#endif
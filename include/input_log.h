@@ -0,0 +1,83 @@
+#ifndef CHIP8_INPUT_LOG_H
+#define CHIP8_INPUT_LOG_H
+
+#include "common.h"
+#include "cpu.h"
+#include <vector>
+
+/// key changes of a run keyed by instruction count, recorded during play
+/// and replayed headless to repeat the run exactly
+class InputLog {
+public:
+    /// key state from an instruction count on, bit n for key n
+    struct Event {
+        uint64_t instruction;
+        uint16_t keys;
+    };
+
+    /// log file format version
+    static constexpr uint16_t file_version = 1;
+
+    /// CXNN seed of the run
+    uint64_t seed = 0;
+    /// instructions per timer tick of the run
+    uint32_t timer_ratio = Cpu::default_timer_ratio;
+    /// hash of memory after the ROM was loaded
+    uint64_t rom_hash = 0;
+    /// instructions the run lasted
+    uint64_t length = 0;
+
+    /// take seed, timer ratio and ROM of a Cpu that just loaded its program
+    void begin(const Cpu &cpu);
+    /// give a Cpu that just loaded its program the seed and timer ratio of
+    /// the log, throws if its ROM is not the recorded one
+    void apply(Cpu &cpu) const;
+    /// true if ram holds the recorded ROM, as after loading it
+    bool matches(const byte *ram) const;
+
+    /// log the current keys of cpu if they changed, before it runs on
+    void record(Cpu &cpu) { add(cpu.get_instructions(), pack(cpu.get_keys())); }
+    /// log keys from an instruction count on, counts must not decrease
+    void add(uint64_t instruction, uint16_t keys);
+    /// drop changes from an instruction count on, after rewinding
+    void truncate(uint64_t instruction);
+
+    /// run count instructions, setting keys as logged; returns early when
+    /// the cpu's debugger stops it
+    void run(Cpu &cpu, uint64_t count);
+
+    const std::vector<Event>& get_events() const { return this->events; }
+
+    /// write the log, false on I/O error
+    bool write(const char *file) const;
+    /// read a log, throws if it is not a valid log
+    static InputLog read(const char *file);
+    /// true if file starts like a log
+    static bool is_log(const char *file);
+    /// read a text input script of FRAME KEYMASK lines (decimal frame, hex
+    /// keys held from that frame on), frames are timer_ratio instructions;
+    /// throws unless frames strictly ascend
+    static InputLog read_script(const char *file, uint32_t timer_ratio);
+
+    /// key buffer to bits
+    static uint16_t pack(const bool *keys) {
+        uint16_t bits = 0;
+        for (size_t k = 0; k < Cpu::key_size; k++) {
+            bits |= uint16_t(keys[k]) << k;
+        }
+        return bits;
+    }
+    /// bits to key buffer
+    static void unpack(uint16_t bits, bool *keys) {
+        for (size_t k = 0; k < Cpu::key_size; k++) {
+            keys[k] = (bits >> k) & 1;
+        }
+    }
+
+private:
+    std::vector<Event> events;
+    /// next event to replay
+    size_t next = 0;
+};
+
+#endif
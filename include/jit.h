@@ -0,0 +1,97 @@
+#ifndef CHIP8_JIT_H
+#define CHIP8_JIT_H
+
+#include "common.h"
+#include "cpu.h"
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CHIP8_JIT 1
+#endif
+
+/// x86-64 translator of straight-line instruction runs, the interpreter
+/// executes every instruction the translator does not handle
+class Jit {
+public:
+    /// translated code: v registers, I, delay timer, sound timer and the
+    /// most instructions to run, returns instructions run
+    using Code = uint32_t (*)(byte *v, word *i, byte *delay_timer, byte *sound_timer, uint32_t limit);
+
+    /// translated run of instructions starting at an even address
+    struct Block {
+        /// native code, null if nothing at this address translates
+        Code code;
+        /// instructions covered
+        word length;
+        /// translation attempted
+        bool translated;
+    };
+
+    /// shortest block worth a native call, in instructions
+    static constexpr size_t min_block = 3;
+    /// longest block in instructions
+    static constexpr size_t max_block = 64;
+    /// max bytes a block depends on, its instructions and the idle loop
+    /// check after the last one
+    static constexpr size_t max_span = max_block * 2 + Cpu::max_decode_span;
+    /// memory for translated code
+    static constexpr size_t code_size = 1 << 20;
+
+    /// throws if the host is not x86-64
+    Jit();
+    ~Jit();
+
+    Jit(const Jit &) = delete;
+    Jit &operator=(const Jit &) = delete;
+
+    /// block starting at even address addr of ram, translated on first use
+    const Block &lookup(size_t addr, const byte *ram) {
+        Block &block = blocks[addr >> 1];
+        if (!block.translated)
+            translate(addr, ram, block);
+        return block;
+    }
+    /// block starting at even address addr of a cpu's memory
+    const Block &lookup(size_t addr, const Cpu &cpu) {
+        Block &block = blocks[addr >> 1];
+        if (!block.translated)
+            translate(addr, cpu.view(addr, max_span), block);
+        return block;
+    }
+
+    /// drop blocks overlapping ram[addr, addr + len), returns the lowest
+    /// dropped block address, addr if none
+    size_t invalidate(size_t addr, size_t len);
+    /// drop all blocks
+    void flush();
+    /// true once after a lookup ran out of code memory and dropped all
+    /// blocks, entries running blocks must be dropped then as their
+    /// stores are no longer seen by invalidate
+    bool take_flushed() {
+        bool was = flushed;
+        flushed = false;
+        return was;
+    }
+
+private:
+    /// one entry per even address
+    std::vector<Block> blocks;
+    /// ram range translated blocks depend on, empty if begin >= end
+    size_t covered_begin = Cpu::mem_size;
+    size_t covered_end = 0;
+
+    /// code memory and bump allocator, pages are made writable only while
+    /// a block is copied in and executable only after, so flush just
+    /// rewinds the allocator
+    byte *code = nullptr;
+    size_t code_used = 0;
+    /// set when translate flushed, see take_flushed
+    bool flushed = false;
+
+    void translate(size_t addr, const byte *ram, Block &block);
+    /// make the pages of code[begin, end) read-write, or read-execute,
+    /// throws if the host refuses
+    void protect(size_t begin, size_t end, bool writable);
+};
+
+#endif
@@ -0,0 +1,637 @@
+#ifndef CHIP8_LOCKSTEP_H
+#define CHIP8_LOCKSTEP_H
+
+#include "common.h"
+#include "cpu.h"
+#include "opcode.h"
+#include "random.h"
+#include "rom_image.h"
+#include <algorithm>
+#include <bitset>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+/// Lanes instances of one ROM stepped together, registers and timers are
+/// stored one array element per lane so an instruction runs on all lanes
+/// at the same pc in one pass over the arrays. Lanes that diverged run in
+/// groups of equal pc, down to one lane per group, lanes waiting in a busy
+/// loop are skipped. A lane behaves exactly like a Cpu running the same
+/// ROM, seed and keys
+template <size_t Lanes>
+class Lockstep {
+    static_assert(Lanes >= 1 && Lanes <= 64, "lanes are bits of a word");
+
+public:
+    /// set of lanes, bit n for lane n
+    using Mask = uint64_t;
+    /// number of lanes
+    static constexpr size_t lanes = Lanes;
+    /// every lane
+    static constexpr Mask all = (Lanes == 64) ? ~Mask(0) : (Mask(1) << Lanes) - 1;
+
+    Lockstep() {
+        std::memset(image, 0, sizeof(image));
+        std::memset(ram, 0, sizeof(ram));
+        for (size_t lane = 0; lane < Lanes; lane++) {
+            timer_ratio[lane] = Cpu::default_timer_ratio;
+            seed[lane] = 0;
+            reset(lane);
+        }
+    }
+
+    /// load a ROM into every lane and reset them
+    void load_program(const char *file) { load_program(RomImage::load(file)); }
+    /// load a ROM image into every lane and reset them
+    void load_program(std::shared_ptr<const RomImage> rom) {
+        std::memcpy(image, rom->ram, sizeof(image));
+        start = RomImage::program_start;
+
+        for (size_t lane = 0; lane < Lanes; lane++) {
+            reset(lane);
+        }
+        split.reset();
+    }
+
+    /// restart a lane from the loaded ROM, it runs again if it was stopped
+    void reset(size_t lane);
+
+    /// stop running a lane, run leaves it as it is until reset
+    void stop(size_t lane) { running &= ~bit(lane); }
+    /// lanes that were not stopped and did not fail
+    Mask get_running() const { return running; }
+    /// why a lane stopped running, empty if it did not fail
+    const std::string &get_error(size_t lane) const { return error[lane]; }
+
+    /// seed CXNN's generator of a lane now and on every reset
+    void set_seed(size_t lane, uint64_t seed) {
+        this->seed[lane] = seed;
+        rng[lane].seed(seed);
+    }
+    /// set instructions per timer tick of a lane
+    void set_timer_ratio(size_t lane, uint32_t ratio) {
+        if (ratio == 0) {
+            throw std::runtime_error("timer ratio must be positive");
+        }
+        // a frame that has not started yet takes the new length
+        timer_countdown[lane] = timer_countdown[lane] == timer_ratio[lane] ? ratio
+                              : std::min(timer_countdown[lane], ratio);
+        timer_ratio[lane] = ratio;
+    }
+
+    /// set pressed keys of a lane, bit n for key n
+    void set_keys(size_t lane, uint16_t keys) { this->keys[lane] = keys; }
+    uint16_t get_keys(size_t lane) const { return keys[lane]; }
+
+    /// run count instructions on every running lane, timers of a lane tick
+    /// every timer_ratio of its instructions
+    void run(uint64_t count);
+
+    /// get executed instruction count of a lane
+    uint64_t get_instructions(size_t lane) const { return instructions[lane]; }
+    /// get registers of a lane
+    Cpu::Register get_registers(size_t lane) const {
+        Cpu::Register reg = {};
+        reg.pc = pc[lane];
+        reg.sp = sp[lane];
+        reg.i = i[lane];
+        for (size_t r = 0; r < 16; r++) {
+            reg.v[r] = v[r][lane];
+        }
+        return reg;
+    }
+    /// get memory of a lane, mem_size bytes
+    const byte *get_ram(size_t lane) const { return ram[lane]; }
+    /// get video buffer of a lane, one row per word
+    const uint64_t *get_vram(size_t lane) const { return vram[lane]; }
+    /// get and clear the changed video rows of a lane, bit n for row n
+    uint32_t take_dirty_rows(size_t lane) {
+        uint32_t rows = dirty_rows[lane];
+        dirty_rows[lane] = 0;
+        return rows;
+    }
+    /// get sound timer of a lane, the buzzer sounds while it is not zero
+    byte get_sound_timer(size_t lane) const { return sound_timer[lane]; }
+
+    /// instructions run so far, per lane
+    uint64_t get_steps() const { return steps; }
+    /// groups of lanes run so far, one per distinct pc in every step that
+    /// was not skipped, groups / steps above 1 means lanes diverged
+    uint64_t get_groups() const { return groups; }
+
+private:
+    static constexpr size_t mem_mask = Cpu::mem_size - 1;
+
+    /// busy wait loop of a lane, that it leaves only when the timers tick
+    /// or the keys change
+    struct Idle {
+        /// loop start
+        word at;
+        /// loop length in instructions, 0 if there is no loop
+        byte period;
+        /// left when the timers tick, else only when keys change
+        bool timed;
+    };
+
+    // registers, one element per lane
+    byte v[16][Lanes];
+    word i[Lanes];
+    word pc[Lanes];
+    byte sp[Lanes];
+    word stack[Cpu::stack_size][Lanes];
+    byte delay_timer[Lanes];
+    byte sound_timer[Lanes];
+    uint16_t keys[Lanes];
+
+    uint32_t timer_ratio[Lanes];
+    uint32_t timer_countdown[Lanes];
+    uint64_t instructions[Lanes];
+    uint32_t dirty_rows[Lanes];
+    Random rng[Lanes];
+    uint64_t seed[Lanes];
+
+    /// lanes that are neither stopped nor failed
+    Mask running = 0;
+    /// running lanes skipped by step while they wait in a loop, the loop
+    /// and the step they entered it at
+    Mask parked = 0;
+    Idle parked_in[Lanes];
+    uint64_t parked_since[Lanes];
+    std::string error[Lanes];
+
+    /// memory of each lane
+    byte ram[Lanes][Cpu::mem_size];
+    /// video memory of each lane, as in Cpu
+    uint64_t vram[Lanes][Cpu::vram_height];
+    /// memory after loading the ROM, and its start address
+    byte image[Cpu::mem_size];
+    word start = 0x200;
+    /// bytes that may differ between lanes, every other byte is equal in all
+    /// lanes so an opcode fetched from one lane holds for all of them
+    std::bitset<Cpu::mem_size> split;
+
+    uint64_t steps = 0;
+    uint64_t groups = 0;
+    /// instructions run in the current slice
+    uint32_t done = 0;
+
+    static Mask bit(size_t lane) { return Mask(1) << lane; }
+
+    word fetch(size_t lane, word addr) const {
+        return word(ram[lane][addr & mem_mask] << 8 | ram[lane][(addr + 1) & mem_mask]);
+    }
+
+    /// stop a lane with an error, the failing instruction is not counted
+    /// as in Cpu
+    void fail(size_t lane, const char *what) {
+        error[lane] = what;
+        running &= ~bit(lane);
+        instructions[lane] += done;
+        timer_countdown[lane] -= done;
+    }
+    /// stop a group of lanes with an error
+    void fail_group(Mask group, const char *what) {
+        for (size_t lane = 0; lane < Lanes; lane++) {
+            if (group & bit(lane))
+                fail(lane, what);
+        }
+    }
+
+    /// call f(lane) for every lane of group, for every lane when All so
+    /// the loop vectorizes without masks
+    template <bool All, typename F>
+    static void each(Mask group, F f) {
+        if (All) {
+            for (size_t lane = 0; lane < Lanes; lane++) {
+                f(lane);
+            }
+        } else {
+            for (; group; group &= group - 1) {
+                f(__builtin_ctzll(group));
+            }
+        }
+    }
+
+    /// execute opcode on a group of lanes at the same pc
+    template <bool All>
+    void execute(word opcode, Mask group);
+
+    /// run one instruction on every running lane that is not parked
+    void step();
+    /// loop of Operations::idle_handler or key wait at pc at, that no lane
+    /// of group leaves until the timers tick or the keys change
+    Idle find_idle(Mask group, word at, word opcode, size_t lead) const;
+    /// let a parked lane run again, it spun in its loop since it was
+    /// parked until step now
+    void unpark(size_t lane, uint64_t now);
+    /// count instructions pass for the timers of every running lane
+    void wait(uint64_t count);
+
+    /// note the bytes a group stored length bytes at from[lane], they stay
+    /// shared only when every lane stored the same bytes at the same place
+    void stored(Mask group, const word *from, size_t length);
+};
+
+template <size_t Lanes>
+void Lockstep<Lanes>::reset(size_t lane) {
+    std::memcpy(ram[lane], image, sizeof(image));
+    std::fill_n(vram[lane], Cpu::vram_height, 0);
+    for (size_t r = 0; r < 16; r++) {
+        v[r][lane] = 0;
+    }
+    for (size_t s = 0; s < Cpu::stack_size; s++) {
+        stack[s][lane] = 0;
+    }
+    i[lane] = 0;
+    pc[lane] = start;
+    sp[lane] = 0;
+    delay_timer[lane] = 0;
+    sound_timer[lane] = 0;
+    keys[lane] = 0;
+    timer_countdown[lane] = timer_ratio[lane];
+    instructions[lane] = 0;
+    dirty_rows[lane] = ~uint32_t(0);
+    rng[lane].seed(seed[lane]);
+
+    running |= bit(lane);
+    error[lane].clear();
+
+    // other lanes may have stored to bytes still marked shared
+    size_t other = (lane + 1) % Lanes;
+    for (size_t addr = 0; addr < Cpu::mem_size && other != lane; addr++) {
+        if (ram[lane][addr] != ram[other][addr])
+            split[addr] = true;
+    }
+}
+
+template <size_t Lanes>
+void Lockstep<Lanes>::run(uint64_t count) {
+    uint64_t end = steps + count;
+    while (steps < end && running) {
+        // no lane's timers tick inside a slice
+        uint32_t slice = uint32_t(std::min<uint64_t>(end - steps, UINT32_MAX));
+        for (size_t lane = 0; lane < Lanes; lane++) {
+            if (running & bit(lane))
+                slice = std::min(slice, timer_countdown[lane]);
+        }
+
+        for (done = 0; done < slice && (running & ~parked); done++) {
+            step();
+        }
+
+        // lanes waiting for the timers leave their loops now
+        bool timed = false;
+        each<false>(parked, [&](size_t lane) { timed = timed || parked_in[lane].timed; });
+        bool waiting = (running & ~parked) == 0;
+        if (waiting && timed)
+            done = slice;
+        each<false>(parked, [&](size_t lane) {
+            if (parked_in[lane].timed)
+                unpark(lane, steps + done);
+        });
+
+        auto tick = [&](size_t lane) {
+            instructions[lane] += done;
+            timer_countdown[lane] -= done;
+            if (timer_countdown[lane] == 0) {
+                timer_countdown[lane] = timer_ratio[lane];
+                delay_timer[lane] -= delay_timer[lane] > 0;
+                sound_timer[lane] -= sound_timer[lane] > 0;
+            }
+        };
+        each<false>(running, tick);
+        steps += done;
+
+        // lanes waiting for keys stay until the end
+        if (waiting && !timed && running)
+            wait(end - steps);
+    }
+    each<false>(parked, [&](size_t lane) { unpark(lane, steps); });
+}
+
+template <size_t Lanes>
+void Lockstep<Lanes>::step() {
+    // one group per distinct pc (and opcode, where memory diverged)
+    Mask pending = running & ~parked;
+    while (pending) {
+        size_t lead = __builtin_ctzll(pending);
+        word at = pc[lead];
+        word opcode = fetch(lead, at);
+
+        bool together = true;
+        for (size_t lane = 0; lane < Lanes; lane++) {
+            together &= pc[lane] == at;
+        }
+        Mask group = pending;
+        if (!together) {
+            for (Mask rest = pending; rest; rest &= rest - 1) {
+                size_t lane = __builtin_ctzll(rest);
+                if (pc[lane] != at)
+                    group &= ~bit(lane);
+            }
+        }
+        if (split[at & mem_mask] || split[(at + 1) & mem_mask]) {
+            for (Mask rest = group; rest; rest &= rest - 1) {
+                size_t lane = __builtin_ctzll(rest);
+                if (fetch(lane, at) != opcode)
+                    group &= ~bit(lane);
+            }
+        }
+        pending &= ~group;
+        groups++;
+
+        Idle idle = find_idle(group, at, opcode, lead);
+        if (idle.period) {
+            each<false>(group, [&](size_t lane) {
+                parked_in[lane] = idle;
+                parked_since[lane] = steps + done;
+            });
+            parked |= group;
+        } else if (group == all) {
+            execute<true>(opcode, group);
+        } else {
+            execute<false>(opcode, group);
+        }
+    }
+}
+
+template <size_t Lanes>
+typename Lockstep<Lanes>::Idle Lockstep<Lanes>::find_idle(Mask group, word at, word opcode, size_t lead) const {
+    const byte *vx = v[(opcode & 0x0f00) >> 8];
+    bool stays = true;
+
+    // FX0A repeats itself until a key is pressed
+    if ((opcode & 0xf0ff) == 0xf00a) {
+        each<false>(group, [&](size_t lane) { stays = stays && keys[lane] == 0; });
+        return stays ? Idle{ at, 1, false } : Idle{};
+    }
+
+    bool candidate = (opcode >> 12) == 0x01 || (opcode >> 12) == 0x0e || (opcode & 0xf0ff) == 0xf007;
+    if (!candidate || at + Cpu::max_decode_span > Cpu::mem_size)
+        return {};
+    for (size_t addr = at; addr < at + Cpu::max_decode_span; addr++) {
+        if (split[addr])
+            return {};
+    }
+
+    // the loops of Operations::idle_handler
+    Operations::Handler handler = Operations::idle_handler(ram[lead], at);
+    if (handler == Operations::jump_self<NoTrace>) {
+        return { at, 1, false };
+    } else if (handler == Operations::wait_key_loop<NoTrace>) {
+        bool pressed = (opcode & 0x00ff) == 0x9e;
+        each<false>(group, [&](size_t lane) {
+            stays = stays && ((keys[lane] >> (vx[lane] & 0x0f)) & 1) != pressed;
+        });
+        return stays ? Idle{ at, 2, false } : Idle{};
+    } else if (handler == Operations::wait_delay<NoTrace>) {
+        each<false>(group, [&](size_t lane) { stays = stays && delay_timer[lane] != 0; });
+        return stays ? Idle{ at, 3, true } : Idle{};
+    }
+    return {};
+}
+
+template <size_t Lanes>
+void Lockstep<Lanes>::unpark(size_t lane, uint64_t now) {
+    const Idle &idle = parked_in[lane];
+    uint64_t spun = now - parked_since[lane];
+    pc[lane] = idle.at + 2 * (spun % idle.period);
+    // the loop reading the delay timer read it at least once
+    if (idle.timed && spun)
+        v[(fetch(lane, idle.at) & 0x0f00) >> 8][lane] = delay_timer[lane];
+    parked &= ~bit(lane);
+}
+
+template <size_t Lanes>
+void Lockstep<Lanes>::wait(uint64_t count) {
+    each<false>(running, [&](size_t lane) {
+        uint64_t ticks = 0;
+        if (count >= timer_countdown[lane]) {
+            uint64_t after = count - timer_countdown[lane];
+            ticks = 1 + after / timer_ratio[lane];
+            timer_countdown[lane] = timer_ratio[lane] - after % timer_ratio[lane];
+        } else {
+            timer_countdown[lane] -= count;
+        }
+        delay_timer[lane] -= std::min<uint64_t>(delay_timer[lane], ticks);
+        sound_timer[lane] -= std::min<uint64_t>(sound_timer[lane], ticks);
+        instructions[lane] += count;
+    });
+    steps += count;
+}
+
+template <size_t Lanes>
+template <bool All>
+void Lockstep<Lanes>::execute(word opcode, Mask group) {
+    word nnn = opcode & 0x0fff;
+    byte x = (opcode & 0x0f00) >> 8;
+    byte y = (opcode & 0x00f0) >> 4;
+    byte kk = opcode & 0x00ff;
+    byte n = opcode & 0x000f;
+    byte *vx = v[x];
+    byte *vy = v[y];
+    byte *vf = v[15];
+
+    each<All>(group, [&](size_t lane) { pc[lane] += 2; });
+
+    switch (opcode >> 12) {
+        case 0x00:
+            if (kk == 0xe0) {
+                // 00E0, clear screen
+                each<All>(group, [&](size_t lane) {
+                    std::fill_n(vram[lane], Cpu::vram_height, 0);
+                    dirty_rows[lane] = ~uint32_t(0);
+                });
+            } else if (kk == 0xee) {
+                // 00EE, return
+                each<All>(group, [&](size_t lane) {
+                    if (sp[lane] == 0)
+                        return fail(lane, "stack underflow");
+                    pc[lane] = stack[--sp[lane]][lane];
+                });
+            }
+            // 0NNN, ignored
+            break;
+
+        // 1NNN, jump
+        case 0x01: each<All>(group, [&](size_t lane) { pc[lane] = nnn; }); break;
+
+        // 2NNN, call
+        case 0x02:
+            each<All>(group, [&](size_t lane) {
+                if (sp[lane] == Cpu::stack_size)
+                    return fail(lane, "stack overflow");
+                stack[sp[lane]++][lane] = pc[lane];
+                pc[lane] = nnn;
+            });
+            break;
+
+        // 3XKK, 4XKK, 5XY0, 9XY0, skips
+        case 0x03: each<All>(group, [&](size_t lane) { pc[lane] += (vx[lane] == kk) * 2; }); break;
+        case 0x04: each<All>(group, [&](size_t lane) { pc[lane] += (vx[lane] != kk) * 2; }); break;
+        case 0x05:
+            if (n)
+                return fail_group(group, "invalid opcode: 5XY0");
+            each<All>(group, [&](size_t lane) { pc[lane] += (vx[lane] == vy[lane]) * 2; });
+            break;
+        case 0x09: each<All>(group, [&](size_t lane) { pc[lane] += (vx[lane] != vy[lane]) * 2; }); break;
+
+        // 6XKK, 7XKK
+        case 0x06: each<All>(group, [&](size_t lane) { vx[lane] = kk; }); break;
+        case 0x07: each<All>(group, [&](size_t lane) { vx[lane] += kk; }); break;
+
+        // 8XYn, flag and result are written in the order of Operations as
+        // x or y may be the flag register
+        case 0x08:
+            switch (n) {
+                case 0x00: each<All>(group, [&](size_t lane) { vx[lane] = vy[lane]; }); break;
+                case 0x01: each<All>(group, [&](size_t lane) { vx[lane] |= vy[lane]; }); break;
+                case 0x02: each<All>(group, [&](size_t lane) { vx[lane] &= vy[lane]; }); break;
+                case 0x03: each<All>(group, [&](size_t lane) { vx[lane] ^= vy[lane]; }); break;
+                case 0x04:
+                    each<All>(group, [&](size_t lane) {
+                        word sum = vx[lane] + vy[lane];
+                        vf[lane] = sum > 0xff;
+                        vx[lane] = byte(sum);
+                    });
+                    break;
+                case 0x05:
+                    each<All>(group, [&](size_t lane) {
+                        vf[lane] = vx[lane] > vy[lane];
+                        vx[lane] -= vy[lane];
+                    });
+                    break;
+                case 0x06:
+                    each<All>(group, [&](size_t lane) {
+                        vf[lane] = vy[lane] & 0x01;
+                        vx[lane] = vy[lane] >> 1;
+                    });
+                    break;
+                case 0x07:
+                    each<All>(group, [&](size_t lane) {
+                        vf[lane] = vy[lane] > vx[lane];
+                        vx[lane] = vy[lane] - vx[lane];
+                    });
+                    break;
+                case 0x0e:
+                    each<All>(group, [&](size_t lane) {
+                        vf[lane] = (vy[lane] & 0x80) != 0;
+                        vx[lane] = vy[lane] << 1;
+                    });
+                    break;
+                default: return fail_group(group, "invalid opcode: 8XYn");
+            }
+            break;
+
+        // ANNN, BNNN, CXKK
+        case 0x0a: each<All>(group, [&](size_t lane) { i[lane] = nnn; }); break;
+        case 0x0b: each<All>(group, [&](size_t lane) { pc[lane] = v[0][lane] + nnn; }); break;
+        case 0x0c: each<All>(group, [&](size_t lane) { vx[lane] = byte(rng[lane]() >> 24) & kk; }); break;
+
+        // DXYN, draw sprite
+        case 0x0d:
+            each<All>(group, [&](size_t lane) {
+                uint64_t collision = 0;
+                for (byte row = 0; row < n; row++) {
+                    byte y_coord = vy[lane] + row;
+                    if (y_coord >= Cpu::vram_height)
+                        continue;
+
+                    uint64_t mask = Operations::sprite_mask(ram[lane][(i[lane] + row) & mem_mask], vx[lane]);
+                    collision |= vram[lane][y_coord] & mask;
+                    vram[lane][y_coord] ^= mask;
+                    dirty_rows[lane] |= uint32_t(mask != 0) << y_coord;
+                }
+                vf[lane] = collision != 0;
+            });
+            break;
+
+        // EX9E, EXA1, key skips
+        case 0x0e:
+            if (kk == 0x9e)
+                each<All>(group, [&](size_t lane) { pc[lane] += ((keys[lane] >> (vx[lane] & 0x0f)) & 1) * 2; });
+            else if (kk == 0xa1)
+                each<All>(group, [&](size_t lane) { pc[lane] += (~(keys[lane] >> (vx[lane] & 0x0f)) & 1) * 2; });
+            else
+                return fail_group(group, "invalid opcode: EXnn");
+            break;
+
+        case 0x0f:
+            switch (kk) {
+                case 0x07: each<All>(group, [&](size_t lane) { vx[lane] = delay_timer[lane]; }); break;
+                case 0x0a:
+                    // wait key, repeats until a key is pressed
+                    each<All>(group, [&](size_t lane) {
+                        if (keys[lane])
+                            vx[lane] = __builtin_ctz(keys[lane]);
+                        else
+                            pc[lane] -= 2;
+                    });
+                    break;
+                case 0x15: each<All>(group, [&](size_t lane) { delay_timer[lane] = vx[lane]; }); break;
+                case 0x18: each<All>(group, [&](size_t lane) { sound_timer[lane] = vx[lane]; }); break;
+                case 0x1e: each<All>(group, [&](size_t lane) { i[lane] += vx[lane]; }); break;
+                case 0x29: each<All>(group, [&](size_t lane) { i[lane] = vx[lane] * Cpu::sprint_size; }); break;
+                case 0x33:
+                    each<All>(group, [&](size_t lane) {
+                        byte value = vx[lane];
+                        ram[lane][i[lane] & mem_mask] = value / 100;
+                        ram[lane][(i[lane] + 1) & mem_mask] = (value % 100) / 10;
+                        ram[lane][(i[lane] + 2) & mem_mask] = value % 10;
+                    });
+                    stored(group, i, 3);
+                    break;
+                case 0x55: {
+                    word from[Lanes];
+                    std::memcpy(from, i, sizeof(from));
+                    each<All>(group, [&](size_t lane) {
+                        for (size_t r = 0; r <= x; r++) {
+                            ram[lane][i[lane]++ & mem_mask] = v[r][lane];
+                        }
+                    });
+                    stored(group, from, x + 1);
+                    break;
+                }
+                case 0x65:
+                    each<All>(group, [&](size_t lane) {
+                        for (size_t r = 0; r <= x; r++) {
+                            v[r][lane] = ram[lane][i[lane]++ & mem_mask];
+                        }
+                    });
+                    break;
+                default: return fail_group(group, "invalid opcode: FXnn");
+            }
+            break;
+    }
+}
+
+template <size_t Lanes>
+void Lockstep<Lanes>::stored(Mask group, const word *from, size_t length) {
+    size_t first = __builtin_ctzll(group);
+    bool same = group == all;
+    for (size_t lane = 0; lane < Lanes && same; lane++) {
+        same = from[lane] == from[first];
+    }
+    for (size_t k = 0; k < length && same; k++) {
+        size_t addr = (from[first] + k) & mem_mask;
+        for (size_t lane = 0; lane < Lanes; lane++) {
+            same = same && ram[lane][addr] == ram[first][addr];
+        }
+    }
+
+    if (same) {
+        // every lane holds the same bytes there now
+        for (size_t k = 0; k < length; k++) {
+            split[(from[first] + k) & mem_mask] = false;
+        }
+        return;
+    }
+    for (size_t lane = 0; lane < Lanes; lane++) {
+        for (size_t k = 0; k < length && (group & bit(lane)); k++) {
+            split[(from[lane] + k) & mem_mask] = true;
+        }
+    }
+}
+
+#endif
@@ -1,433 +1,771 @@
-#ifndef CHIP8_OPCODE_H
-#define CHIP8_OPCODE_H
-
-#include <algorithm>
-#include <cstdio>
-#include <cstdlib>
-#include <cassert>
-
-#include "common.h"
-#include "cpu.h"
-
-// opcode access helper, assumed little-endian
-union Opcode {
-    word word;
-    struct {
-        byte low;
-        byte high;
-    };
-};
-
-class Operations {
-public:
-    // 00E0, clear screen
-    static void cls(Cpu &cpu, Opcode = {}) {
-        std::fill_n(cpu.vram, sizeof(cpu.vram), 0);
-        cpu.update_gui = true;
-    
-        if (cpu.debug)
-            printf("CLS\n");
-    }
-
-    // 00EE, return
-    static void ret(Cpu &cpu, Opcode = {}) {
-        cpu.reg.pc = cpu.stack[--cpu.reg.sp];
-    
-        if (cpu.debug)
-            printf("RET\n");
-    }
-
-    // 1NNN, jump
-    static void jump(Cpu &cpu, Opcode code) {
-        cpu.reg.pc = code.word;
-        
-        if (cpu.debug)
-            printf("JP   0x%04X\n", code.word);
-    }
-
-    // 2NNN, call
-    static void call(Cpu &cpu, Opcode code) {
-        cpu.stack[cpu.reg.sp++] = cpu.reg.pc;
-        cpu.reg.pc = code.word;
-    
-        if (cpu.debug)
-            printf("CALL 0x%04X\n", code.word);
-    }
-
-    // 3XKK, skip next instruction if reg[x] == kk
-    static void skip_eq(Cpu &cpu, Opcode code) {
-        byte vx = code.high;
-        byte value = code.low;
-
-        if (cpu.reg.v[vx] == value)
-            cpu.reg.pc += 2;
-    
-        if (cpu.debug)
-            printf("SE   V%X, 0x%04X\n", vx, value);
-    }
-
-    // 4XKK, skip next instruction if reg[x] != kk
-    static void skip_not_eq(Cpu &cpu, Opcode code) {
-        byte vx = code.high;
-        byte value = code.low;
-
-        if (cpu.reg.v[vx] != value)
-            cpu.reg.pc += 2;
-    
-        if (cpu.debug)
-            printf("SNE  V%X, 0x%04X\n", vx, value);
-    }
-
-    // 5XY0, skip next instruction if reg[x] == reg[y]
-    static void skip_eq_reg(Cpu &cpu, Opcode code) {
-        byte vx = code.high;
-        byte vy = (code.low & 0xf0) >> 4;
-
-        if (cpu.reg.v[vx] == cpu.reg.v[vy])
-            cpu.reg.pc += 2;
-    
-        if (cpu.debug)
-            printf("SE   V%X, V%X\n", vx, vy);
-    }
-
-    // 6XKK, load reg: reg[x] = kk
-    static void load_reg_value(Cpu &cpu, Opcode code) {
-        byte vx = code.high;
-        byte value = code.low;
-
-        cpu.reg.v[vx] = value;
-    
-        if (cpu.debug)
-            printf("LD   V%X, 0x%04X\n", vx, value);
-    }
-
-    // 7XKK, add reg: reg[x] += kk
-    static void add_reg_value(Cpu &cpu, Opcode code) {
-        byte vx = code.high;
-        byte value = code.low;
-
-        cpu.reg.v[vx] += value;
-    
-        if (cpu.debug)
-            printf("ADD  V%X, 0x%04X\n", vx, value);
-    }
-
-    // 8XY0, load reg: reg[x] = reg[y]
-    static void load_reg_reg(Cpu &cpu, Opcode code) {
-        byte vx = code.high;
-        byte vy = (code.low & 0xf0) >> 4;
-        
-        cpu.reg.v[vx] = cpu.reg.v[vy];
-    
-        if (cpu.debug)
-            printf("LD   V%X, V%X\n", vx, vy);
-    }
-
-    // 8XY1, or: reg[x] |= reg[y]
-    static void or_reg_reg(Cpu &cpu, Opcode code) {
-        byte vx = code.high;
-        byte vy = (code.low & 0xf0) >> 4;
-        
-        cpu.reg.v[vx] |= cpu.reg.v[vy];
-    
-        if (cpu.debug)
-            printf("OR   V%X, V%X\n", vx, vy);
-    }
-
-    // 8XY2, and: reg[x] &= reg[y]
-    static void and_reg_reg(Cpu &cpu, Opcode code) {
-        byte vx = code.high;
-        byte vy = (code.low & 0xf0) >> 4;
-        
-        cpu.reg.v[vx] &= cpu.reg.v[vy];
-    
-        if (cpu.debug)
-            printf("AND  V%X, V%X\n", vx, vy);
-    }
-
-    // 8XY3, xor: reg[x] ^= reg[y]
-    static void xor_reg_reg(Cpu &cpu, Opcode code) {
-        byte vx = code.high;
-        byte vy = (code.low & 0xf0) >> 4;
-        
-        cpu.reg.v[vx] ^= cpu.reg.v[vy];
-    
-        if (cpu.debug)
-            printf("XOR  V%X, V%X\n", vx, vy);
-    }
-
-    // 8XY4, add: reg[x] += reg[y]
-    static void add_reg_reg(Cpu &cpu, Opcode code) {
-        byte vx = code.high;
-        byte vy = (code.low & 0xf0) >> 4;
-        
-        word sum = cpu.reg.v[vx] + cpu.reg.v[vy];
-        cpu.reg.v_flag = (sum > 0xff) ? 1 : 0;
-        cpu.reg.v[vx] = sum % 0x100;
-    
-        if (cpu.debug)
-            printf("ADD  V%X, V%X\n", vx, vy);
-    }
-
-    // 8XY5, sub: reg[x] -= reg[y]
-    static void sub_reg_reg(Cpu &cpu, Opcode code) {
-        byte vx = code.high;
-        byte vy = (code.low & 0xf0) >> 4;
-
-        cpu.reg.v_flag = (cpu.reg.v[vx] > cpu.reg.v[vy]) ? 1 : 0;
-        cpu.reg.v[vx] -= cpu.reg.v[vy];
-    
-        if (cpu.debug)
-            printf("SUB  V%X, V%X\n", vx, vy);
-    }
-
-    // 8XY6, shift right
-    static void shr_reg_reg(Cpu &cpu, Opcode code) {
-        byte vx = code.high;
-        byte vy = (code.low & 0xf0) >> 4;
-        
-        cpu.reg.v_flag = cpu.reg.v[vy] & 0x01;
-        cpu.reg.v[vx] = cpu.reg.v[vy] >> 1;
-    
-        if (cpu.debug)
-            printf("SHR  V%X, V%X\n", vx, vy);
-    }
-
-    // 8XY7, sub negative: reg[x] = reg[y] - reg[x]
-    static void subn_reg_reg(Cpu &cpu, Opcode code) {
-        byte vx = code.high;
-        byte vy = (code.low & 0xf0) >> 4;
-        
-        cpu.reg.v_flag = (cpu.reg.v[vy] > cpu.reg.v[vx]) ? 1 : 0;
-        cpu.reg.v[vx] = cpu.reg.v[vy] - cpu.reg.v[vx];
-    
-        if (cpu.debug)
-            printf("SUBN V%X, V%X\n", vx, vy);
-    }
-
-    // 8XYE, shift left
-    static void shl_reg_reg(Cpu &cpu, Opcode code) {
-        byte vx = code.high;
-        byte vy = (code.low & 0xf0) >> 4;
-        
-        cpu.reg.v_flag = (cpu.reg.v[vy] & 0x80) ? 1 : 0;
-        cpu.reg.v[vx] = cpu.reg.v[vy] << 1;
-    
-        if (cpu.debug)
-            printf("SHL  V%X, V%X\n", vx, vy);
-    }
-
-    // 9XY0, skip next instruction if reg[x] != reg[y]
-    static void skip_not_eq_reg(Cpu &cpu, Opcode code) {
-        byte vx = code.high;
-        byte vy = (code.low & 0xf0) >> 4;
-
-        if (cpu.reg.v[vx] != cpu.reg.v[vy])
-            cpu.reg.pc += 2;
-    
-        if (cpu.debug)
-            printf("SNE  V%X, V%X\n", vx, vy);
-    }
-
-    // ANNN, load address: reg_i = nnn
-    static void load_i_addr(Cpu &cpu, Opcode code) {
-        cpu.reg.i = code.word;
-    
-        if (cpu.debug)
-            printf("LD   I,  0x%04X\n", code.word);
-    }
-
-    // BNNN, jump to address: nnn + reg[0]
-    static void jump_relative(Cpu &cpu, Opcode code) {
-        cpu.reg.pc = cpu.reg.v[0] + code.word;
-    
-        if (cpu.debug)
-            printf("JP   V0, 0x%04X\n", code.word);
-    }
-
-    // CXNN, random: reg[x] = rand() & nn
-    static void rand_mask(Cpu &cpu, Opcode code) {
-        byte vx = code.high;
-        byte value = code.low;
-
-        cpu.reg.v[vx] = (rand() % 0x100) & value;
-    
-        if (cpu.debug)
-            printf("RND  V%X, 0x%04X\n", vx, value);
-    }
-
-    // DXYN, draw sprite at (x,y) with n bytes of data
-    static void draw_sprite(Cpu &cpu, Opcode code) {
-        byte vx = code.high;
-        byte vy = (code.low & 0xf0) >> 4;
-        byte n = (code.low & 0x0f);
-        byte x = cpu.reg.v[vx];
-        byte y = cpu.reg.v[vy];
-
-        cpu.reg.v_flag = 0;
-        for (byte i = 0; i < n; i++) {
-            byte data = cpu.ram[cpu.reg.i + i];
-            byte y_coord = y + i;
-            if (y_coord >= Cpu::vram_height) {
-                continue;
-            }
-
-            for (byte j = 0; j < 8; j++) {
-                byte x_coord = (x + 8 - j - 1);
-                if (x_coord >= Cpu::vram_width) {
-                    data >>= 1;
-                    continue;
-                }
-
-                word pos = Cpu::vram_width * y_coord + x_coord;
-
-                byte bit = data & 0x1;
-                if (bit & cpu.vram[pos]) {
-                    cpu.reg.v_flag = 1;
-                }
-                cpu.vram[pos] ^= bit;
-
-                data >>= 1;
-            }
-        }
-        cpu.update_gui = true;
-    
-        if (cpu.debug)
-            printf("DRW  V%X, V%X, 0x%X\n", vx, vy, n);
-    }
-
-    // EX9E, skip if keys[reg[x]] pressed
-    static void skip_pressed(Cpu &cpu, Opcode code) {
-        byte vx = code.high;
-
-        if (cpu.keys[cpu.reg.v[vx]])
-            cpu.reg.pc += 2;
-    
-        if (cpu.debug)
-            printf("SKP  V%X\n", vx);
-    }
-
-    // EXA1, skip if keys[reg[x]] not pressed
-    static void skip_not_pressed(Cpu &cpu, Opcode code) {
-        byte vx = code.high;
-
-        if (!cpu.keys[cpu.reg.v[vx]])
-            cpu.reg.pc += 2;
-    
-        if (cpu.debug)
-            printf("SKNP V%X\n", vx);
-    }
-
-    // FX07, load reg: reg[x] = delay_timer
-    static void load_reg_delay(Cpu &cpu, Opcode code) {
-        byte vx = code.high;
-
-        cpu.reg.v[vx] = cpu.delay_timer;
-    
-        if (cpu.debug)
-            printf("LD   V%X, DT\n", vx);
-    }
-
-    // FX0A, wait key: reg[x] = key
-    static void load_wait_key(Cpu &cpu, Opcode code) {
-        byte vx = code.high;
-
-        bool has_key = false;
-        for (size_t i = 0; i < sizeof(cpu.keys); i++) {
-            if (cpu.keys[i]) {
-                cpu.reg.v[vx] = i;
-                has_key = true;
-                break;
-            }
-        }
-
-        // instead of waiting, just execute same operation to simulate
-        if (!has_key) {
-            cpu.reg.pc -= 2;
-        }
-    
-        if (cpu.debug)
-            printf("LD   V%X, KEY\n", vx);
-    }
-
-    // FX15, load delay timer
-    static void load_delay_reg(Cpu &cpu, Opcode code) {
-        byte vx = code.high;
-
-        cpu.delay_timer = cpu.reg.v[vx];
-    
-        if (cpu.debug)
-            printf("LD   DT, V%X\n", vx);
-    }
-
-    // FX18, load sound timer
-    static void load_sound_reg(Cpu &cpu, Opcode code) {
-        byte vx = code.high;
-
-        cpu.sound_timer = cpu.reg.v[vx];
-    
-        if (cpu.debug)
-            printf("LD   ST, V%X\n", vx);
-    }
-
-    // FX1E, add: reg.i += reg[x]
-    static void add_i_reg(Cpu &cpu, Opcode code) {
-        byte vx = code.high;
-
-        cpu.reg.i += cpu.reg.v[vx];
-    
-        if (cpu.debug)
-            printf("ADD  I,  V%X\n", vx);
-    }
-
-    // FX29, load sprite
-    static void load_sprite(Cpu &cpu, Opcode code) {
-        byte vx = code.high;
-
-        cpu.reg.i = cpu.reg.v[vx] * Cpu::sprint_size;
-    
-        if (cpu.debug)
-            printf("LD   F, 0x%X\n", vx);
-    }
-
-    // FX33, store bcd value of reg[x] at reg.i[0:3]
-    static void store_bcd(Cpu &cpu, Opcode code) {
-        byte vx = code.high;
-        byte value = cpu.reg.v[vx];
-
-        cpu.ram[cpu.reg.i] = value / 100;
-        cpu.ram[cpu.reg.i + 1] = (value % 100) / 10;
-        cpu.ram[cpu.reg.i + 2] = value % 10;
-    
-        if (cpu.debug)
-            printf("LD BCD,  V%X\n", vx);
-    }
-
-    // FX55, store register values to [I]
-    static void store_regs(Cpu &cpu, Opcode code) {
-        byte vx = code.high;
-
-        assert(vx <= sizeof(cpu.reg.v));
-        for (int i = 0; i <= vx; i++) {
-            cpu.ram[cpu.reg.i++] = cpu.reg.v[i];
-        }
-    
-        if (cpu.debug)
-            printf("LD   [I], V%X\n", vx);
-    }
-
-    // FX65, load values at [I] to registers
-    static void load_regs(Cpu &cpu, Opcode code) {
-        byte vx = code.high;
-
-        assert(vx <= sizeof(cpu.reg.v));
-        for (int i = 0; i <= vx; i++) {
-            cpu.reg.v[i] = cpu.ram[cpu.reg.i++];
-        }
-    
-        if (cpu.debug)
-            printf("LD   V%X, [I]\n", vx);
-    }
-};
-
-#endif
+#ifndef CHIP8_OPCODE_H
+#define CHIP8_OPCODE_H
+
+#include <algorithm>
+#include <bitset>
+#include <cassert>
+#include <stdexcept>
+
+#include "aot.h"
+#include "common.h"
+#include "cpu.h"
+#include "debugger.h"
+#include "jit.h"
+#include "profile.h"
+#include "trace.h"
+
+class Operations {
+public:
+    // 0NNN, machine code routine, ignored
+    template <typename Trace>
+    static void nop(Cpu &, const Instruction &) {}
+
+    // 00E0, clear screen
+    template <typename Trace>
+    static void cls(Cpu &cpu, const Instruction &) {
+        std::fill_n(cpu.vram, Cpu::vram_height, 0);
+        cpu.dirty_rows = ~uint32_t(0);
+        cpu.hash_rows = ~uint32_t(0);
+    
+        Trace::log("CLS\n");
+    }
+
+    // 00EE, return
+    template <typename Trace>
+    static void ret(Cpu &cpu, const Instruction &) {
+        if (cpu.reg.sp == 0)
+            throw std::runtime_error("stack underflow");
+        cpu.reg.pc = cpu.stack[--cpu.reg.sp];
+    
+        Trace::log("RET\n");
+    }
+
+    // 1NNN, jump
+    template <typename Trace>
+    static void jump(Cpu &cpu, const Instruction &ins) {
+        cpu.reg.pc = ins.nnn;
+        
+        Trace::log("JP   0x%04X\n", ins.nnn);
+    }
+
+    // 2NNN, call
+    template <typename Trace>
+    static void call(Cpu &cpu, const Instruction &ins) {
+        if (cpu.reg.sp == Cpu::stack_size)
+            throw std::runtime_error("stack overflow");
+        cpu.stack[cpu.reg.sp++] = cpu.reg.pc;
+        cpu.reg.pc = ins.nnn;
+    
+        Trace::log("CALL 0x%04X\n", ins.nnn);
+    }
+
+    // 3XKK, skip next instruction if reg[x] == kk
+    template <typename Trace>
+    static void skip_eq(Cpu &cpu, const Instruction &ins) {
+        byte vx = ins.x;
+        byte value = ins.kk;
+
+        if (cpu.reg.v[vx] == value)
+            cpu.reg.pc += 2;
+    
+        Trace::log("SE   V%X, 0x%04X\n", vx, value);
+    }
+
+    // 4XKK, skip next instruction if reg[x] != kk
+    template <typename Trace>
+    static void skip_not_eq(Cpu &cpu, const Instruction &ins) {
+        byte vx = ins.x;
+        byte value = ins.kk;
+
+        if (cpu.reg.v[vx] != value)
+            cpu.reg.pc += 2;
+    
+        Trace::log("SNE  V%X, 0x%04X\n", vx, value);
+    }
+
+    // 5XY0, skip next instruction if reg[x] == reg[y]
+    template <typename Trace>
+    static void skip_eq_reg(Cpu &cpu, const Instruction &ins) {
+        byte vx = ins.x;
+        byte vy = ins.y;
+
+        if (cpu.reg.v[vx] == cpu.reg.v[vy])
+            cpu.reg.pc += 2;
+    
+        Trace::log("SE   V%X, V%X\n", vx, vy);
+    }
+
+    // 6XKK, load reg: reg[x] = kk
+    template <typename Trace>
+    static void load_reg_value(Cpu &cpu, const Instruction &ins) {
+        byte vx = ins.x;
+        byte value = ins.kk;
+
+        cpu.reg.v[vx] = value;
+    
+        Trace::log("LD   V%X, 0x%04X\n", vx, value);
+    }
+
+    // 7XKK, add reg: reg[x] += kk
+    template <typename Trace>
+    static void add_reg_value(Cpu &cpu, const Instruction &ins) {
+        byte vx = ins.x;
+        byte value = ins.kk;
+
+        cpu.reg.v[vx] += value;
+    
+        Trace::log("ADD  V%X, 0x%04X\n", vx, value);
+    }
+
+    // 8XY0, load reg: reg[x] = reg[y]
+    template <typename Trace>
+    static void load_reg_reg(Cpu &cpu, const Instruction &ins) {
+        byte vx = ins.x;
+        byte vy = ins.y;
+        
+        cpu.reg.v[vx] = cpu.reg.v[vy];
+    
+        Trace::log("LD   V%X, V%X\n", vx, vy);
+    }
+
+    // 8XY1, or: reg[x] |= reg[y]
+    template <typename Trace>
+    static void or_reg_reg(Cpu &cpu, const Instruction &ins) {
+        byte vx = ins.x;
+        byte vy = ins.y;
+        
+        cpu.reg.v[vx] |= cpu.reg.v[vy];
+    
+        Trace::log("OR   V%X, V%X\n", vx, vy);
+    }
+
+    // 8XY2, and: reg[x] &= reg[y]
+    template <typename Trace>
+    static void and_reg_reg(Cpu &cpu, const Instruction &ins) {
+        byte vx = ins.x;
+        byte vy = ins.y;
+        
+        cpu.reg.v[vx] &= cpu.reg.v[vy];
+    
+        Trace::log("AND  V%X, V%X\n", vx, vy);
+    }
+
+    // 8XY3, xor: reg[x] ^= reg[y]
+    template <typename Trace>
+    static void xor_reg_reg(Cpu &cpu, const Instruction &ins) {
+        byte vx = ins.x;
+        byte vy = ins.y;
+        
+        cpu.reg.v[vx] ^= cpu.reg.v[vy];
+    
+        Trace::log("XOR  V%X, V%X\n", vx, vy);
+    }
+
+    // 8XY4, add: reg[x] += reg[y]
+    template <typename Trace>
+    static void add_reg_reg(Cpu &cpu, const Instruction &ins) {
+        byte vx = ins.x;
+        byte vy = ins.y;
+        
+        word sum = cpu.reg.v[vx] + cpu.reg.v[vy];
+        cpu.reg.v_flag = (sum > 0xff) ? 1 : 0;
+        cpu.reg.v[vx] = sum % 0x100;
+    
+        Trace::log("ADD  V%X, V%X\n", vx, vy);
+    }
+
+    // 8XY5, sub: reg[x] -= reg[y]
+    template <typename Trace>
+    static void sub_reg_reg(Cpu &cpu, const Instruction &ins) {
+        byte vx = ins.x;
+        byte vy = ins.y;
+
+        cpu.reg.v_flag = (cpu.reg.v[vx] > cpu.reg.v[vy]) ? 1 : 0;
+        cpu.reg.v[vx] -= cpu.reg.v[vy];
+    
+        Trace::log("SUB  V%X, V%X\n", vx, vy);
+    }
+
+    // 8XY6, shift right
+    template <typename Trace>
+    static void shr_reg_reg(Cpu &cpu, const Instruction &ins) {
+        byte vx = ins.x;
+        byte vy = ins.y;
+        
+        cpu.reg.v_flag = cpu.reg.v[vy] & 0x01;
+        cpu.reg.v[vx] = cpu.reg.v[vy] >> 1;
+    
+        Trace::log("SHR  V%X, V%X\n", vx, vy);
+    }
+
+    // 8XY7, sub negative: reg[x] = reg[y] - reg[x]
+    template <typename Trace>
+    static void subn_reg_reg(Cpu &cpu, const Instruction &ins) {
+        byte vx = ins.x;
+        byte vy = ins.y;
+        
+        cpu.reg.v_flag = (cpu.reg.v[vy] > cpu.reg.v[vx]) ? 1 : 0;
+        cpu.reg.v[vx] = cpu.reg.v[vy] - cpu.reg.v[vx];
+    
+        Trace::log("SUBN V%X, V%X\n", vx, vy);
+    }
+
+    // 8XYE, shift left
+    template <typename Trace>
+    static void shl_reg_reg(Cpu &cpu, const Instruction &ins) {
+        byte vx = ins.x;
+        byte vy = ins.y;
+        
+        cpu.reg.v_flag = (cpu.reg.v[vy] & 0x80) ? 1 : 0;
+        cpu.reg.v[vx] = cpu.reg.v[vy] << 1;
+    
+        Trace::log("SHL  V%X, V%X\n", vx, vy);
+    }
+
+    // 9XY0, skip next instruction if reg[x] != reg[y]
+    template <typename Trace>
+    static void skip_not_eq_reg(Cpu &cpu, const Instruction &ins) {
+        byte vx = ins.x;
+        byte vy = ins.y;
+
+        if (cpu.reg.v[vx] != cpu.reg.v[vy])
+            cpu.reg.pc += 2;
+    
+        Trace::log("SNE  V%X, V%X\n", vx, vy);
+    }
+
+    // ANNN, load address: reg_i = nnn
+    template <typename Trace>
+    static void load_i_addr(Cpu &cpu, const Instruction &ins) {
+        cpu.reg.i = ins.nnn;
+    
+        Trace::log("LD   I,  0x%04X\n", ins.nnn);
+    }
+
+    // BNNN, jump to address: nnn + reg[0]
+    template <typename Trace>
+    static void jump_relative(Cpu &cpu, const Instruction &ins) {
+        cpu.reg.pc = cpu.reg.v[0] + ins.nnn;
+    
+        Trace::log("JP   V0, 0x%04X\n", ins.nnn);
+    }
+
+    // CXNN, random: reg[x] = random byte & nn
+    template <typename Trace>
+    static void rand_mask(Cpu &cpu, const Instruction &ins) {
+        byte vx = ins.x;
+        byte value = ins.kk;
+
+        cpu.reg.v[vx] = byte(cpu.rng() >> 24) & value;
+    
+        Trace::log("RND  V%X, 0x%04X\n", vx, value);
+    }
+
+    // DXYN, draw sprite at (x,y) with n bytes of data
+    template <typename Trace>
+    static void draw_sprite(Cpu &cpu, const Instruction &ins) {
+        byte vx = ins.x;
+        byte vy = ins.y;
+        byte n = ins.n;
+        byte x = cpu.reg.v[vx];
+        byte y = cpu.reg.v[vy];
+
+        uint64_t collision = 0;
+        uint32_t changed = 0;
+        size_t pixels = 0, erased = 0;
+        for (byte i = 0; i < n; i++) {
+            byte y_coord = y + i;
+            if (y_coord >= Cpu::vram_height) {
+                continue;
+            }
+
+            uint64_t mask = sprite_mask(cpu.read(cpu.reg.i + i), x);
+            if (Trace::profile) {
+                pixels += std::bitset<64>(mask).count();
+                erased += std::bitset<64>(cpu.vram[y_coord] & mask).count();
+            }
+            collision |= cpu.vram[y_coord] & mask;
+            cpu.vram[y_coord] ^= mask;
+            changed |= uint32_t(mask != 0) << y_coord;
+        }
+        cpu.dirty_rows |= changed;
+        cpu.hash_rows |= changed;
+        cpu.reg.v_flag = collision ? 1 : 0;
+        if (Trace::watch)
+            cpu.debugger->check_access(cpu.reg, cpu.reg.i, n, Debugger::read);
+        if (Trace::profile)
+            cpu.profiler->record_draw(pixels, erased);
+
+        Trace::log("DRW  V%X, V%X, 0x%X\n", vx, vy, n);
+    }
+
+    // EX9E, skip if keys[reg[x]] pressed
+    template <typename Trace>
+    static void skip_pressed(Cpu &cpu, const Instruction &ins) {
+        byte vx = ins.x;
+
+        if (cpu.keys[cpu.reg.v[vx]])
+            cpu.reg.pc += 2;
+    
+        Trace::log("SKP  V%X\n", vx);
+    }
+
+    // EXA1, skip if keys[reg[x]] not pressed
+    template <typename Trace>
+    static void skip_not_pressed(Cpu &cpu, const Instruction &ins) {
+        byte vx = ins.x;
+
+        if (!cpu.keys[cpu.reg.v[vx]])
+            cpu.reg.pc += 2;
+    
+        Trace::log("SKNP V%X\n", vx);
+    }
+
+    // FX07, load reg: reg[x] = delay_timer
+    template <typename Trace>
+    static void load_reg_delay(Cpu &cpu, const Instruction &ins) {
+        byte vx = ins.x;
+
+        cpu.reg.v[vx] = cpu.delay_timer;
+    
+        Trace::log("LD   V%X, DT\n", vx);
+    }
+
+    // FX0A, wait key: reg[x] = key
+    template <typename Trace>
+    static void load_wait_key(Cpu &cpu, const Instruction &ins) {
+        byte vx = ins.x;
+
+        bool has_key = false;
+        for (size_t i = 0; i < sizeof(cpu.keys); i++) {
+            if (cpu.keys[i]) {
+                cpu.reg.v[vx] = i;
+                has_key = true;
+                break;
+            }
+        }
+
+        // instead of waiting, just execute same operation to simulate,
+        // keys only change between slices so the rest of it would spin
+        if (!has_key) {
+            cpu.reg.pc -= 2;
+            if (!Trace::enabled)
+                cpu.budget = 0;
+        }
+    
+        Trace::log("LD   V%X, KEY\n", vx);
+    }
+
+    // FX15, load delay timer
+    template <typename Trace>
+    static void load_delay_reg(Cpu &cpu, const Instruction &ins) {
+        byte vx = ins.x;
+
+        cpu.delay_timer = cpu.reg.v[vx];
+    
+        Trace::log("LD   DT, V%X\n", vx);
+    }
+
+    // FX18, load sound timer
+    template <typename Trace>
+    static void load_sound_reg(Cpu &cpu, const Instruction &ins) {
+        byte vx = ins.x;
+
+        cpu.sound_timer = cpu.reg.v[vx];
+    
+        Trace::log("LD   ST, V%X\n", vx);
+    }
+
+    // FX1E, add: reg.i += reg[x]
+    template <typename Trace>
+    static void add_i_reg(Cpu &cpu, const Instruction &ins) {
+        byte vx = ins.x;
+
+        cpu.reg.i += cpu.reg.v[vx];
+    
+        Trace::log("ADD  I,  V%X\n", vx);
+    }
+
+    // FX29, load sprite
+    template <typename Trace>
+    static void load_sprite(Cpu &cpu, const Instruction &ins) {
+        byte vx = ins.x;
+
+        cpu.reg.i = cpu.reg.v[vx] * Cpu::sprint_size;
+    
+        Trace::log("LD   F, 0x%X\n", vx);
+    }
+
+    // FX33, store bcd value of reg[x] at reg.i[0:3]
+    template <typename Trace>
+    static void store_bcd(Cpu &cpu, const Instruction &ins) {
+        byte vx = ins.x;
+        byte value = cpu.reg.v[vx];
+
+        byte digits[3] = { byte(value / 100), byte((value % 100) / 10), byte(value % 10) };
+        cpu.store(cpu.reg.i, digits, sizeof(digits));
+        if (Trace::watch)
+            cpu.debugger->check_access(cpu.reg, cpu.reg.i, 3, Debugger::write);
+    
+        Trace::log("LD BCD,  V%X\n", vx);
+    }
+
+    // FX55, store register values to [I]
+    template <typename Trace>
+    static void store_regs(Cpu &cpu, const Instruction &ins) {
+        byte vx = ins.x;
+
+        assert(vx <= sizeof(cpu.reg.v));
+        cpu.store(cpu.reg.i, cpu.reg.v, vx + 1);
+        if (Trace::watch)
+            cpu.debugger->check_access(cpu.reg, cpu.reg.i, vx + 1, Debugger::write);
+        cpu.reg.i += vx + 1;
+    
+        Trace::log("LD   [I], V%X\n", vx);
+    }
+
+    // FX65, load values at [I] to registers
+    template <typename Trace>
+    static void load_regs(Cpu &cpu, const Instruction &ins) {
+        byte vx = ins.x;
+
+        assert(vx <= sizeof(cpu.reg.v));
+        cpu.load(cpu.reg.i, cpu.reg.v, vx + 1);
+        if (Trace::watch)
+            cpu.debugger->check_access(cpu.reg, cpu.reg.i, vx + 1, Debugger::read);
+        cpu.reg.i += vx + 1;
+    
+        Trace::log("LD   V%X, [I]\n", vx);
+    }
+
+    // 1NNN jumping to itself, spins until the end of the slice
+    template <typename Trace>
+    static void jump_self(Cpu &cpu, const Instruction &ins) {
+        // the jump drops the bits above 0xFFF of a loop entered through them
+        cpu.reg.pc = ins.nnn;
+        cpu.budget = 0;
+    }
+
+    // FX07 3X00 1NNN polling the delay timer at nnn, the timer only
+    // changes between slices so skip the remaining loop iterations
+    template <typename Trace>
+    static void wait_delay(Cpu &cpu, const Instruction &ins) {
+        byte vx = ins.x;
+
+        cpu.reg.v[vx] = cpu.delay_timer;
+        if (cpu.delay_timer == 0)
+            return;
+
+        // pc after the remaining SE, JP, LD sequence, it keeps the bits
+        // above 0xFFF of a loop entered through them until the first jump
+        static constexpr byte offset[] = { 2, 4, 0 };
+        word start = cpu.budget < 2 ? word(cpu.reg.pc - 2) : ins.nnn;
+        cpu.reg.pc = start + offset[cpu.budget % 3];
+        cpu.budget = 0;
+    }
+
+    // EX9E / EXA1 followed by 1NNN back to it at nnn, spins until the key
+    // changes which only happens between slices
+    template <typename Trace>
+    static void wait_key_loop(Cpu &cpu, const Instruction &ins) {
+        byte vx = ins.x;
+        bool skip = cpu.keys[cpu.reg.v[vx]] == (ins.kk == 0x9e);
+
+        if (skip) {
+            cpu.reg.pc += 2;
+            return;
+        }
+
+        // pc after the remaining JP, SKP sequence, it stays past this
+        // instruction (keeping bits above 0xFFF) when nothing remains
+        if (cpu.budget > 0)
+            cpu.reg.pc = ins.nnn + ((cpu.budget & 1) ? 0 : 2);
+        cpu.budget = 0;
+    }
+
+    // 6XKK 6YKK, y and kk2 hold the second load
+    template <typename Trace>
+    static void load_reg_value_pair(Cpu &cpu, const Instruction &ins) {
+        cpu.reg.v[ins.x] = ins.kk;
+        if (!advance(cpu))
+            return;
+        cpu.reg.v[ins.y] = ins.kk2;
+    }
+
+    // ANNN DXYN, x, y and n hold the draw operands
+    template <typename Trace>
+    static void load_i_draw(Cpu &cpu, const Instruction &ins) {
+        cpu.reg.i = ins.nnn;
+        if (!advance(cpu))
+            return;
+        draw_sprite<Trace>(cpu, ins);
+    }
+
+    // 7XKK 3YKK, y and kk2 hold the skip operands
+    template <typename Trace>
+    static void add_skip_eq(Cpu &cpu, const Instruction &ins) {
+        cpu.reg.v[ins.x] += ins.kk;
+        if (!advance(cpu))
+            return;
+        if (cpu.reg.v[ins.y] == ins.kk2)
+            cpu.reg.pc += 2;
+    }
+
+    // 7XKK 4YKK, y and kk2 hold the skip operands
+    template <typename Trace>
+    static void add_skip_not_eq(Cpu &cpu, const Instruction &ins) {
+        cpu.reg.v[ins.x] += ins.kk;
+        if (!advance(cpu))
+            return;
+        if (cpu.reg.v[ins.y] != ins.kk2)
+            cpu.reg.pc += 2;
+    }
+
+    using Handler = void (*)(Cpu &, const Instruction &);
+
+    /// idle handler if a busy wait loop starts at addr, null otherwise,
+    /// loops span at most Cpu::max_decode_span bytes
+    static Handler idle_handler(const byte *ram, size_t addr) {
+        auto opcode = [&](size_t at) -> word {
+            return (at + 1 < Cpu::mem_size) ? (ram[at] << 8 | ram[at + 1]) : 0;
+        };
+        word op = opcode(addr);
+        word next = opcode(addr + 2);
+        word jump_back = 0x1000 | addr;
+
+        if (op == jump_back)
+            return jump_self<NoTrace>;
+        if ((op & 0xf0ff) == 0xf007 && next == (0x3000 | (op & 0x0f00))
+            && opcode(addr + 4) == jump_back)
+            return wait_delay<NoTrace>;
+        if (((op & 0xf0ff) == 0xe09e || (op & 0xf0ff) == 0xe0a1) && next == jump_back)
+            return wait_key_loop<NoTrace>;
+        return nullptr;
+    }
+
+    // decode cache miss, decode the entry in place then execute it
+    template <typename Trace>
+    static void decode_entry(Cpu &cpu, const Instruction &) {
+        // step moved pc past the entry
+        size_t addr = (cpu.reg.pc - 2) & (Cpu::mem_size - 1);
+
+        Instruction decoded = decode_at<Trace>(cpu.view(addr, cpu.decode_span()), addr, cpu.aot, cpu.jit.get());
+        // the translator dropped every block, entries still running them
+        // would miss stores to their code
+        if (cpu.jit && cpu.jit->take_flushed())
+            cpu.map_decoded();
+
+        Instruction &entry = cpu.own_entry(addr);
+        entry = decoded;
+        entry.exec(cpu, entry);
+    }
+
+    /// decode cache entry at even addr of ram: idle loop, compiled block,
+    /// translated block (if jit is not null), fused pair or single
+    /// instruction, throws if the opcode is invalid
+    template <typename Trace>
+    static Instruction decode_at(const byte *ram, size_t addr, const AotProgram *aot, Jit *jit) {
+        Instruction entry = decode<Trace>(word(ram[addr] << 8 | ram[addr + 1]));
+        if (!Trace::enabled && !detect_idle(ram, addr, entry)) {
+            const AotProgram::Block *compiled = aot ? aot->lookup(addr, ram) : nullptr;
+            if (compiled) {
+                entry.exec = compiled->exec;
+                entry.nnn = addr;
+            } else if (jit && jit->lookup(addr, ram).length) {
+                entry.exec = run_block;
+                entry.nnn = addr;
+            } else {
+                detect_pair(ram, addr, entry);
+            }
+        }
+        return entry;
+    }
+
+    // translated run of instructions starting at nnn
+    static void run_block(Cpu &cpu, const Instruction &ins) {
+        const Jit::Block &block = cpu.jit->lookup(ins.nnn, cpu);
+        if (cpu.jit->take_flushed())
+            cpu.map_decoded();
+        if (!block.code) {
+            // the code changed into something too short to translate,
+            // decode it again for the interpreter
+            cpu.decode_miss(cpu, ins);
+            return;
+        }
+        // step already took the first instruction off the budget
+        uint32_t done = block.code(cpu.reg.v, &cpu.reg.i, &cpu.delay_timer, &cpu.sound_timer,
+                                   cpu.budget + 1);
+        // from the entry pc, which keeps bits above 0xFFF that nnn drops
+        cpu.reg.pc += (done - 1) * 2;
+        cpu.budget -= done - 1;
+    }
+
+    /// execute a constant opcode, for compiled blocks
+    template <word opcode>
+    static void exec(Cpu &cpu) {
+        static constexpr Instruction ins = decode<NoTrace>(opcode);
+        ins.exec(cpu, ins);
+    }
+
+    /// move a compiled block or fused pair to its next instruction, false
+    /// when the slice is used up
+    static bool advance(Cpu &cpu) {
+        if (cpu.budget == 0)
+            return false;
+        cpu.budget--;
+        cpu.reg.pc += 2;
+        return true;
+    }
+
+    /// place a sprite byte at column x of a video row, columns are bytes
+    /// so x + 7 may wrap around to the left edge, clipped at the right edge
+    static uint64_t sprite_mask(byte data, byte x) {
+        constexpr int msb = Cpu::vram_width - 8;
+
+        if (x <= msb)
+            return uint64_t(data) << (msb - x);
+        else if (x < Cpu::vram_width)
+            return uint64_t(data) >> (x - msb);
+        else if (x >= 0x100 - 7)
+            return uint64_t(data) << (msb + 0x100 - x);
+        return 0;
+    }
+
+    /// resolve handler and extract operands of an opcode
+    template <typename Trace>
+    static constexpr Instruction decode(word opcode) {
+        Instruction ins = {};
+        ins.nnn = opcode & 0x0fff;
+        ins.x = (opcode & 0x0f00) >> 8;
+        ins.y = (opcode & 0x00f0) >> 4;
+        ins.kk = opcode & 0x00ff;
+        ins.n = opcode & 0x000f;
+        ins.exec = handler<Trace>(opcode >> 12, ins);
+        return ins;
+    }
+
+private:
+    /// replace an entry starting a busy wait loop with its idle handler,
+    /// false if there is no loop at addr
+    static bool detect_idle(const byte *ram, size_t addr, Instruction &entry) {
+        Handler idle = idle_handler(ram, addr);
+        if (idle) {
+            entry.exec = idle;
+            entry.nnn = addr;
+        }
+        return idle != nullptr;
+    }
+
+    /// replace an entry starting a common instruction pair with its fused
+    /// handler, pairs span 4 bytes
+    static void detect_pair(const byte *ram, size_t addr, Instruction &entry) {
+        if (addr + 3 >= Cpu::mem_size)
+            return;
+        word op = ram[addr] << 8 | ram[addr + 1];
+        word next = ram[addr + 2] << 8 | ram[addr + 3];
+        byte next_x = (next & 0x0f00) >> 8;
+        byte next_kk = next & 0x00ff;
+
+        switch (op >> 12) {
+            case 0x06:
+                if ((next >> 12) == 0x06) {
+                    entry.exec = load_reg_value_pair<NoTrace>;
+                    entry.y = next_x;
+                    entry.kk2 = next_kk;
+                }
+                break;
+            case 0x07:
+                if ((next >> 12) == 0x03 || (next >> 12) == 0x04) {
+                    entry.exec = (next >> 12) == 0x03 ? add_skip_eq<NoTrace> : add_skip_not_eq<NoTrace>;
+                    entry.y = next_x;
+                    entry.kk2 = next_kk;
+                }
+                break;
+            case 0x0a:
+                if ((next >> 12) == 0x0d) {
+                    entry.exec = load_i_draw<NoTrace>;
+                    entry.x = next_x;
+                    entry.y = (next & 0x00f0) >> 4;
+                    entry.n = next & 0x000f;
+                }
+                break;
+        }
+    }
+
+    template <typename Trace>
+    static constexpr Handler handler(byte type, const Instruction &ins) {
+        switch (type) {
+            case 0x00: {
+                if (ins.kk == 0xe0)
+                    return cls<Trace>;
+                else if (ins.kk == 0xee)
+                    return ret<Trace>;
+                // ignore others
+                return nop<Trace>;
+            }
+
+            case 0x01: return jump<Trace>;
+            case 0x02: return call<Trace>;
+            case 0x03: return skip_eq<Trace>;
+            case 0x04: return skip_not_eq<Trace>;
+
+            case 0x05: {
+                if (ins.n)
+                    throw std::runtime_error("invalid opcode: 5XY0");
+                return skip_eq_reg<Trace>;
+            }
+
+            case 0x06: return load_reg_value<Trace>;
+            case 0x07: return add_reg_value<Trace>;
+
+            case 0x08: {
+                switch (ins.n) {
+                    case 0x00: return load_reg_reg<Trace>;
+                    case 0x01: return or_reg_reg<Trace>;
+                    case 0x02: return and_reg_reg<Trace>;
+                    case 0x03: return xor_reg_reg<Trace>;
+                    case 0x04: return add_reg_reg<Trace>;
+                    case 0x05: return sub_reg_reg<Trace>;
+                    case 0x06: return shr_reg_reg<Trace>;
+                    case 0x07: return subn_reg_reg<Trace>;
+                    case 0x0e: return shl_reg_reg<Trace>;
+                    default: throw std::runtime_error("invalid opcode: 8XYn");
+                }
+            }
+
+            case 0x09: return skip_not_eq_reg<Trace>;
+            case 0x0a: return load_i_addr<Trace>;
+            case 0x0b: return jump_relative<Trace>;
+            case 0x0c: return rand_mask<Trace>;
+            case 0x0d: return draw_sprite<Trace>;
+
+            case 0x0e: {
+                if (ins.kk == 0x9e)
+                    return skip_pressed<Trace>;
+                else if (ins.kk == 0xa1)
+                    return skip_not_pressed<Trace>;
+                else
+                    throw std::runtime_error("invalid opcode: EXnn");
+            }
+
+            case 0x0f: {
+                switch (ins.kk) {
+                    case 0x07: return load_reg_delay<Trace>;
+                    case 0x0A: return load_wait_key<Trace>;
+                    case 0x15: return load_delay_reg<Trace>;
+                    case 0x18: return load_sound_reg<Trace>;
+                    case 0x1E: return add_i_reg<Trace>;
+                    case 0x29: return load_sprite<Trace>;
+                    case 0x33: return store_bcd<Trace>;
+                    case 0x55: return store_regs<Trace>;
+                    case 0x65: return load_regs<Trace>;
+                    default: throw std::runtime_error("invalid opcode: FXnn");
+                }
+            }
+
+            default: throw std::runtime_error("impossible!!!");
+        }
+    }
+};
+
+#endif
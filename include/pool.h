@@ -0,0 +1,65 @@
+#ifndef CHIP8_POOL_H
+#define CHIP8_POOL_H
+
+#include "common.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// work-stealing thread pool, tasks must not throw
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit ThreadPool(size_t threads = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /// queue a task on the next worker
+    void submit(Task task);
+    /// block until every submitted task finished
+    void wait();
+
+    /// number of workers
+    size_t size() const { return workers.size(); }
+
+private:
+    /// per worker task queue, owner pops back, thieves pop front
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    /// round robin submit target
+    std::atomic<size_t> next{0};
+    /// tasks queued but not started
+    std::atomic<size_t> queued{0};
+    /// tasks submitted but not finished
+    std::atomic<size_t> pending{0};
+    /// workers asleep or about to sleep, submit wakes one only then
+    std::atomic<size_t> sleeping{0};
+    bool stopping = false;
+
+    /// taken only to sleep and wake, tasks move through the queues
+    /// without it
+    std::mutex state_lock;
+    std::condition_variable work_ready;
+    std::condition_variable all_done;
+
+    /// take a task from own queue, or steal from others
+    bool pop(size_t self, Task &task);
+    /// worker main loop
+    void work(size_t self);
+};
+
+#endif
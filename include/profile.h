@@ -0,0 +1,134 @@
+#ifndef CHIP8_PROFILE_H
+#define CHIP8_PROFILE_H
+
+#include "common.h"
+#include <cstdio>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// execution counts of a profiled Cpu (Cpu::set_profiler), per opcode
+/// class, per address and per call stack built from CALL / RET
+class Profiler {
+public:
+    /// opcode classes, one per Operations handler
+    enum OpClass {
+        op_sys, op_cls, op_ret, op_jp, op_call, op_se, op_sne, op_se_reg,
+        op_ld, op_add, op_ld_reg, op_or, op_and, op_xor, op_add_reg, op_sub,
+        op_shr, op_subn, op_shl, op_sne_reg, op_ld_i, op_jp_v0, op_rnd, op_drw,
+        op_skp, op_sknp, op_ld_dt_get, op_ld_key, op_ld_dt_set, op_ld_st, op_add_i, op_ld_f,
+        op_bcd, op_store, op_load, op_invalid,
+        op_class_count,
+    };
+
+    Profiler();
+
+    /// class of an opcode
+    static OpClass classify(word opcode) {
+        byte kk = opcode & 0x00ff;
+        switch (opcode >> 12) {
+            case 0x00: return kk == 0xe0 ? op_cls : kk == 0xee ? op_ret : op_sys;
+            case 0x01: return op_jp;
+            case 0x02: return op_call;
+            case 0x03: return op_se;
+            case 0x04: return op_sne;
+            case 0x05: return (opcode & 0x000f) ? op_invalid : op_se_reg;
+            case 0x06: return op_ld;
+            case 0x07: return op_add;
+            case 0x08: {
+                static const OpClass alu[16] = {
+                    op_ld_reg, op_or, op_and, op_xor, op_add_reg, op_sub, op_shr, op_subn,
+                    op_invalid, op_invalid, op_invalid, op_invalid, op_invalid, op_invalid, op_shl, op_invalid,
+                };
+                return alu[opcode & 0x000f];
+            }
+            case 0x09: return op_sne_reg;
+            case 0x0a: return op_ld_i;
+            case 0x0b: return op_jp_v0;
+            case 0x0c: return op_rnd;
+            case 0x0d: return op_drw;
+            case 0x0e: return kk == 0x9e ? op_skp : kk == 0xa1 ? op_sknp : op_invalid;
+            default:
+                switch (kk) {
+                    case 0x07: return op_ld_dt_get;
+                    case 0x0a: return op_ld_key;
+                    case 0x15: return op_ld_dt_set;
+                    case 0x18: return op_ld_st;
+                    case 0x1e: return op_add_i;
+                    case 0x29: return op_ld_f;
+                    case 0x33: return op_bcd;
+                    case 0x55: return op_store;
+                    case 0x65: return op_load;
+                    default: return op_invalid;
+                }
+        }
+    }
+
+    /// opcode pattern and mnemonic of a class
+    static const char *class_name(OpClass op);
+
+    /// count one instruction, called before it runs
+    void record(word pc, word opcode) {
+        OpClass op = classify(opcode);
+        classes[op]++;
+        addresses[pc & (addresses.size() - 1)]++;
+        nodes[current].count++;
+
+        if (op == op_call) {
+            enter(opcode & 0x0fff);
+        } else if (op == op_ret && current != 0) {
+            current = nodes[current].parent;
+        }
+    }
+
+    /// count one DXYN, pixels drawn and pixels erased by it
+    void record_draw(size_t pixels, size_t collisions) {
+        draws++;
+        drawn_pixels += pixels;
+        collided_pixels += collisions;
+        collided_draws += collisions != 0;
+    }
+
+    /// drop all counts
+    void clear();
+
+    /// instructions counted
+    uint64_t total() const;
+
+    /// write opcode classes and hottest addresses sorted by count, and draw counts
+    void write_report(FILE *out, size_t top_addresses = 32) const;
+    /// write call stacks in folded format ("main;sub_0x2A4 123" per line),
+    /// as read by flamegraph.pl and speedscope
+    void write_folded(FILE *out) const;
+
+private:
+    /// call stack node, a function entered from its parent
+    struct Node {
+        size_t parent;
+        word function;
+        uint64_t count;
+    };
+
+    uint64_t classes[op_class_count];
+    /// counts by address
+    std::vector<uint64_t> addresses;
+
+    /// call tree, node 0 is the program start
+    std::vector<Node> nodes;
+    /// (parent, function) to child node
+    std::map<std::pair<size_t, word>, size_t> children;
+    size_t current = 0;
+
+    uint64_t draws = 0;
+    uint64_t drawn_pixels = 0;
+    uint64_t collided_pixels = 0;
+    uint64_t collided_draws = 0;
+
+    /// move to the child of current for a call to function
+    void enter(word function);
+    /// frame names from the root to node, separated by ';'
+    std::string stack_name(size_t node) const;
+};
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef CHIP8_RANDOM_H
+#define CHIP8_RANDOM_H
+
+#include "common.h"
+
+/// PCG32 (XSH RR) generator, small enough to live in every Cpu and be
+/// copied into save states as one word
+class Random {
+public:
+    explicit Random(uint64_t seed = 0) { this->seed(seed); }
+
+    /// restart the sequence of seed
+    void seed(uint64_t seed) {
+        state = 0;
+        (*this)();
+        state += seed;
+        (*this)();
+    }
+
+    /// next 32 random bits
+    uint32_t operator()() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ull + increment;
+        uint32_t shifted = uint32_t(((old >> 18) ^ old) >> 27);
+        uint32_t rotate = uint32_t(old >> 59);
+        return (shifted >> rotate) | (shifted << ((32 - rotate) & 31));
+    }
+
+    /// generator state, saved and restored as is
+    uint64_t state;
+
+private:
+    static constexpr uint64_t increment = 1442695040888963407ull;
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef CHIP8_REWIND_H
+#define CHIP8_REWIND_H
+
+#include "common.h"
+#include "cpu.h"
+#include <deque>
+#include <vector>
+
+/// frame history in a bounded memory budget, each frame is stored as a
+/// run-length encoded xor of its save state against a periodic keyframe
+class Rewind {
+public:
+    /// keep at most memory_budget bytes, full state every keyframe_interval frames
+    explicit Rewind(size_t memory_budget, uint32_t keyframe_interval = 120);
+
+    /// record the current state as the newest frame
+    void push(const Cpu &cpu);
+    /// restore the newest frame and drop it, false if history is empty
+    bool step_back(Cpu &cpu);
+    /// drop all history
+    void clear();
+
+    /// number of recorded frames
+    size_t frames() const { return count; }
+    /// bytes used by recorded frames
+    size_t memory() const { return used; }
+
+private:
+    /// keyframe followed by deltas of the frames recorded after it
+    struct Segment {
+        std::vector<byte> keyframe;
+        /// concatenated frame deltas
+        std::vector<byte> deltas;
+        /// start of each delta in deltas
+        std::vector<uint32_t> offsets;
+    };
+
+    size_t memory_budget;
+    uint32_t keyframe_interval;
+
+    std::deque<Segment> segments;
+    size_t count = 0;
+    size_t used = 0;
+
+    /// scratch save state
+    std::vector<byte> state;
+
+    /// bytes accounted for a segment
+    static size_t segment_size(const Segment &segment);
+    /// append rle(a ^ b) to out
+    static void encode(const byte *a, const byte *b, size_t size, std::vector<byte> &out);
+    /// xor an encoded delta into state
+    static void apply(const byte *delta, const byte *end, byte *state);
+};
+
+#endif
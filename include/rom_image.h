@@ -0,0 +1,36 @@
+#ifndef CHIP8_ROM_IMAGE_H
+#define CHIP8_ROM_IMAGE_H
+
+#include "common.h"
+#include "cpu.h"
+#include <memory>
+
+/// memory of a Cpu right after loading a ROM, with every instruction
+/// decoded. Built once per ROM and shared read-only by all Cpus running
+/// it: their memory pages point into the image until the guest writes them
+struct RomImage {
+    /// load address of programs and start pc
+    static constexpr size_t program_start = 0x200;
+    /// max program size
+    static constexpr size_t max_program_size = Cpu::mem_size - program_start;
+
+    /// fonts and program
+    byte ram[Cpu::mem_size];
+    /// decode cache of a Cpu without tracing and translator, one entry per
+    /// even address, entries that do not decode are decode cache misses
+    Instruction decoded[Cpu::mem_size / 2];
+    /// StateHash of each memory page, as seeded by Cpu::state_hash
+    uint64_t page_hashes[Cpu::page_count];
+    /// registered compiled program of the ROM, null if none
+    const AotProgram *aot;
+
+    /// read a ROM file, longer files are cut at the end of memory, throws
+    /// if it can not be opened
+    static std::shared_ptr<const RomImage> load(const char *file);
+    /// image of a program in memory, throws if it does not fit
+    static std::shared_ptr<const RomImage> create(const byte *program, size_t size);
+    /// image without program, fonts only
+    static std::shared_ptr<const RomImage> blank();
+};
+
+#endif
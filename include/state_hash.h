@@ -0,0 +1,128 @@
+#ifndef CHIP8_STATE_HASH_H
+#define CHIP8_STATE_HASH_H
+
+#include "common.h"
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+/// 64 bit hashes of machine state parts, Cpu::state_hash combines them
+struct StateHash {
+    /// bijective 64 bit finalizer
+    static uint64_t mix(uint64_t x) {
+        x ^= x >> 32;
+        x *= 0xd6e8feb86659fd93ull;
+        x ^= x >> 32;
+        x *= 0xd6e8feb86659fd93ull;
+        x ^= x >> 32;
+        return x;
+    }
+
+    /// hash of size bytes, parts hashed with different seeds combine by xor
+    static uint64_t bytes(const byte *data, size_t size, uint64_t seed) {
+        // 128 bit products of word pairs folded to 64 bits, independent
+        // per pair so they run in parallel
+        uint64_t hash = mix(seed ^ size);
+        uint64_t key = seed * golden;
+        size_t k = 0;
+        for (; k + 16 <= size; k += 16) {
+            uint64_t a, b;
+            std::memcpy(&a, data + k, 8);
+            std::memcpy(&b, data + k + 8, 8);
+            key += golden;
+            hash ^= fold(a ^ key, b ^ ~key);
+        }
+        if (k < size) {
+            uint64_t tail[2] = {};
+            std::memcpy(tail, data + k, size - k);
+            key += golden;
+            hash ^= fold(tail[0] ^ key, tail[1] ^ ~key);
+        }
+        return mix(hash);
+    }
+
+private:
+    static constexpr uint64_t golden = 0x9e3779b97f4a7c15ull;
+
+    static uint64_t fold(uint64_t a, uint64_t b) {
+#ifdef __SIZEOF_INT128__
+        __extension__ using uint128 = unsigned __int128;
+        uint128 product = uint128(a) * b;
+        return uint64_t(product) ^ uint64_t(product >> 64);
+#else
+        return mix(a) ^ (mix(b) << 1 | mix(b) >> 63);
+#endif
+    }
+};
+
+/// set of state hashes shared by search threads, lock-free open addressing
+/// with a fixed capacity. Equal hashes count as the same state, 0 and 1
+/// are one entry
+class VisitedSet {
+public:
+    /// room for capacity hashes, the table is at least twice as large
+    explicit VisitedSet(size_t capacity) : capacity(capacity) {
+        size_t size = 16;
+        while (size < capacity * 2)
+            size *= 2;
+        mask = size - 1;
+        slots.reset(new std::atomic<uint64_t>[size]);
+        clear();
+    }
+
+    /// add hash, true if it was not in the set yet; throws when the set
+    /// holds capacity hashes already
+    bool insert(uint64_t hash) {
+        uint64_t key = hash ? hash : 1;
+        for (size_t k = key & mask;; k = (k + 1) & mask) {
+            uint64_t seen = slots[k].load(std::memory_order_relaxed);
+            if (seen == key)
+                return false;
+            if (seen)
+                continue;
+
+            if (count.fetch_add(1, std::memory_order_relaxed) >= capacity) {
+                count.fetch_sub(1, std::memory_order_relaxed);
+                throw std::runtime_error("visited set full");
+            }
+            if (slots[k].compare_exchange_strong(seen, key, std::memory_order_relaxed))
+                return true;
+            // another thread took the slot first, maybe with this hash
+            count.fetch_sub(1, std::memory_order_relaxed);
+            if (seen == key)
+                return false;
+        }
+    }
+
+    /// whether hash was inserted
+    bool contains(uint64_t hash) const {
+        uint64_t key = hash ? hash : 1;
+        for (size_t k = key & mask;; k = (k + 1) & mask) {
+            uint64_t seen = slots[k].load(std::memory_order_relaxed);
+            if (seen == key)
+                return true;
+            if (!seen)
+                return false;
+        }
+    }
+
+    /// number of hashes in the set
+    size_t size() const { return count.load(std::memory_order_relaxed); }
+
+    /// remove all hashes, not safe while other threads insert
+    void clear() {
+        for (size_t k = 0; k <= mask; k++) {
+            slots[k].store(0, std::memory_order_relaxed);
+        }
+        count.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    std::unique_ptr<std::atomic<uint64_t>[]> slots;
+    size_t mask;
+    size_t capacity;
+    std::atomic<size_t> count{0};
+};
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef CHIP8_TERM_H
+#define CHIP8_TERM_H
+
+#include "common.h"
+#include "cpu.h"
+#include <cstdio>
+#include <string>
+
+/// video memory as text for ANSI terminals, two pixel rows per line drawn
+/// with Unicode half blocks. Each frame only the cells that changed since
+/// the previous one are sent, jumping over unchanged runs with cursor moves
+class TermScreen {
+public:
+    /// terminal lines used by the screen
+    static constexpr size_t lines = Cpu::vram_height / 2;
+
+    /// escape sequences turning vram into what is on the terminal, the
+    /// first frame clears the terminal and hides the cursor
+    std::string update(const uint64_t *vram) {
+        std::string out;
+        if (!started) {
+            out += "\x1b[?25l\x1b[2J";
+            // nothing matches, so every cell is sent
+            for (size_t y = 0; y < Cpu::vram_height; y++) {
+                shown[y] = ~vram[y];
+            }
+            started = true;
+        }
+
+        for (size_t line = 0; line < lines; line++) {
+            uint64_t top = vram[2 * line], bottom = vram[2 * line + 1];
+            uint64_t changed = (top ^ shown[2 * line]) | (bottom ^ shown[2 * line + 1]);
+            if (!changed)
+                continue;
+            shown[2 * line] = top;
+            shown[2 * line + 1] = bottom;
+
+            // cursor column after the last cell written on this line, none yet
+            size_t cursor = Cpu::vram_width + 1;
+            for (size_t x = 0; x < Cpu::vram_width; x++) {
+                uint64_t bit = uint64_t(1) << (Cpu::vram_width - 1 - x);
+                if (!(changed & bit))
+                    continue;
+
+                if (cursor <= x && gap_cost(top, bottom, cursor, x) <= move_cost(line, x)) {
+                    // rewriting the unchanged cells in between is shorter
+                    for (; cursor < x; cursor++) {
+                        out += cell(top, bottom, cursor);
+                    }
+                } else if (cursor != x) {
+                    char move[16];
+                    snprintf(move, sizeof(move), "\x1b[%zu;%zuH", line + 1, x + 1);
+                    out += move;
+                }
+                out += cell(top, bottom, x);
+                cursor = x + 1;
+            }
+        }
+        return out;
+    }
+
+    /// escape sequences leaving the terminal usable below the screen
+    static std::string finish() {
+        char out[32];
+        snprintf(out, sizeof(out), "\x1b[%zu;1H\x1b[?25h", lines + 1);
+        return out;
+    }
+
+private:
+    /// rows currently on the terminal
+    uint64_t shown[Cpu::vram_height] = {};
+    bool started = false;
+
+    /// half block for the pixels of column x in rows top and bottom
+    static const char *cell(uint64_t top, uint64_t bottom, size_t x) {
+        static const char *const blocks[4] = { " ", "▄", "▀", "█" };
+        size_t shift = Cpu::vram_width - 1 - x;
+        return blocks[((top >> shift) & 1) << 1 | ((bottom >> shift) & 1)];
+    }
+
+    /// bytes of the cells in columns [from, to)
+    static size_t gap_cost(uint64_t top, uint64_t bottom, size_t from, size_t to) {
+        size_t cost = 0;
+        for (size_t x = from; x < to; x++) {
+            cost += std::char_traits<char>::length(cell(top, bottom, x));
+        }
+        return cost;
+    }
+
+    /// bytes of a cursor move to line, column x
+    static size_t move_cost(size_t line, size_t x) {
+        return 4 + (line + 1 >= 10) + 1 + (x + 1 >= 10) + 1;
+    }
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef CHIP8_TRACE_H
+#define CHIP8_TRACE_H
+
+#include <cstdio>
+
+// enabled: every instruction is dispatched on its own, no idle loop
+// skipping, fused pairs or compiled blocks
+// print: dump registers after each instruction
+// profile: count instructions and draws in the Cpu's Profiler
+// record: push each instruction to the Cpu's TraceRing
+// watch: check the Cpu's Debugger for breakpoints and memory watchpoints
+
+/// tracing policy: print every instruction
+struct PrintTrace {
+    static constexpr bool enabled = true;
+    static constexpr bool print = true;
+    static constexpr bool profile = false;
+    static constexpr bool record = false;
+    static constexpr bool watch = false;
+
+    static void log(const char *msg) {
+        fputs(msg, stdout);
+    }
+
+    template <typename... Args>
+    static void log(const char *fmt, Args... args) {
+        printf(fmt, args...);
+    }
+};
+
+/// tracing policy: count executions, print nothing
+struct ProfileTrace {
+    static constexpr bool enabled = true;
+    static constexpr bool print = false;
+    static constexpr bool profile = true;
+    static constexpr bool record = false;
+    static constexpr bool watch = false;
+
+    template <typename... Args>
+    static void log(const char *, Args...) {}
+};
+
+/// tracing policy: record every instruction in a binary ring, print nothing
+struct RingTrace {
+    static constexpr bool enabled = true;
+    static constexpr bool print = false;
+    static constexpr bool profile = false;
+    static constexpr bool record = true;
+    static constexpr bool watch = false;
+
+    template <typename... Args>
+    static void log(const char *, Args...) {}
+};
+
+/// tracing policy: stop at breakpoints and watched memory, print nothing
+struct WatchTrace {
+    static constexpr bool enabled = true;
+    static constexpr bool print = false;
+    static constexpr bool profile = false;
+    static constexpr bool record = false;
+    static constexpr bool watch = true;
+
+    template <typename... Args>
+    static void log(const char *, Args...) {}
+};
+
+/// tracing policy: compiled out
+struct NoTrace {
+    static constexpr bool enabled = false;
+    static constexpr bool print = false;
+    static constexpr bool profile = false;
+    static constexpr bool record = false;
+    static constexpr bool watch = false;
+
+    template <typename... Args>
+    static void log(const char *, Args...) {}
+};
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef CHIP8_TRACE_RING_H
+#define CHIP8_TRACE_RING_H
+
+#include "common.h"
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+/// fixed-size ring of the last executed instructions (Cpu::set_trace),
+/// one writer, snapshots may be taken from any thread without locking.
+/// Slots are copied through relaxed atomics and checked against head
+/// afterwards like a seqlock, records overwritten meanwhile are dropped
+class TraceRing {
+public:
+    /// machine state before an instruction ran, the registers it changed
+    /// are the difference to the next record
+    struct Record {
+        word pc;
+        word opcode;
+        word i;
+        byte v[16];
+    };
+
+    /// trace file format version
+    static constexpr uint16_t file_version = 1;
+
+    /// keep the last capacity records, rounded up to a power of two
+    explicit TraceRing(size_t capacity = 1 << 16);
+
+    TraceRing(const TraceRing &) = delete;
+    TraceRing &operator=(const TraceRing &) = delete;
+
+    /// append a record, overwriting the oldest one when full
+    void push(word pc, word opcode, word i, const byte *v) {
+        uint64_t n = head.load(std::memory_order_relaxed);
+        Record record;
+        record.pc = pc;
+        record.opcode = opcode;
+        record.i = i;
+        std::memcpy(record.v, v, sizeof(record.v));
+
+        uint64_t words[slot_words] = {};
+        std::memcpy(words, &record, sizeof(record));
+        // a snapshot that reads any of these words sees head >= n after
+        std::atomic_thread_fence(std::memory_order_release);
+        Slot &slot = slots[n & mask];
+        for (size_t k = 0; k < slot_words; k++) {
+            slot.words[k].store(words[k], std::memory_order_relaxed);
+        }
+        head.store(n + 1, std::memory_order_release);
+    }
+
+    /// copy of the newest records (at most count), oldest first
+    std::vector<Record> snapshot(size_t count = SIZE_MAX) const;
+    /// drop all records
+    void clear() { head.store(0, std::memory_order_release); }
+
+    /// records pushed since construction or clear
+    uint64_t pushed() const { return head.load(std::memory_order_acquire); }
+    /// max records kept
+    size_t capacity() const { return slots.size(); }
+
+    /// write a snapshot to a trace file, false on I/O error
+    bool write(const char *file, size_t count = SIZE_MAX) const;
+    /// read a trace file, throws if it is not a valid trace
+    static std::vector<Record> read(const char *file);
+
+private:
+    /// a record as atomic words, so snapshots racing the writer are
+    /// well defined
+    static constexpr size_t slot_words = (sizeof(Record) + 7) / 8;
+    struct Slot {
+        std::atomic<uint64_t> words[slot_words];
+    };
+
+    std::vector<Slot> slots;
+    size_t mask;
+    /// total records pushed, next slot is head & mask
+    std::atomic<uint64_t> head{0};
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef CHIP8_TRIPLE_BUFFER_H
+#define CHIP8_TRIPLE_BUFFER_H
+
+#include "common.h"
+#include <atomic>
+
+/// lock-free hand over of values from one writer thread to one reader
+/// thread. Writer and reader each own a slot, the third one holds the
+/// newest published value; neither side ever waits and the reader always
+/// gets the newest value, values published in between are dropped
+template <typename T>
+class TripleBuffer {
+public:
+    /// slot the writer fills, owned by the writer until publish
+    T &back() { return slots[back_index].value; }
+
+    /// hand the back slot to the reader, the writer gets the slot it
+    /// replaced, holding an older value
+    void publish() {
+        byte old = middle.exchange(back_index | fresh, std::memory_order_acq_rel);
+        back_index = old & index_mask;
+    }
+
+    /// take the newest published value as front, false if nothing was
+    /// published since the last take
+    bool take() {
+        if (!(middle.load(std::memory_order_relaxed) & fresh))
+            return false;
+        byte old = middle.exchange(front_index, std::memory_order_acq_rel);
+        front_index = old & index_mask;
+        return true;
+    }
+
+    /// value the reader took last
+    const T &front() const { return slots[front_index].value; }
+
+private:
+    /// slot index bits and the not yet taken flag of middle
+    static constexpr byte index_mask = 3;
+    static constexpr byte fresh = 4;
+
+    /// slots on their own cache lines, written by different threads
+    struct alignas(64) Slot {
+        T value{};
+    };
+
+    Slot slots[3];
+    /// index of the published slot, with fresh until taken
+    alignas(64) std::atomic<byte> middle{1};
+    /// writer's slot
+    alignas(64) byte back_index = 0;
+    /// reader's slot
+    alignas(64) byte front_index = 2;
+};
+
+#endif
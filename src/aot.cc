@@ -0,0 +1,36 @@
+#include "aot.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+/// programs linked into this binary
+static std::vector<const AotProgram*> &registry() {
+    static std::vector<const AotProgram*> programs;
+    return programs;
+}
+
+const AotProgram::Block *AotProgram::lookup(size_t addr, const byte *ram) const {
+    const Block *end = blocks + block_count;
+    const Block *block = std::lower_bound(blocks, end, addr,
+        [](const Block &b, size_t addr) { return b.addr < addr; });
+    if (block == end || block->addr != addr)
+        return nullptr;
+
+    // self-modified code runs in the interpreter
+    if (std::memcmp(ram + addr, image + (addr - origin), block->size) != 0)
+        return nullptr;
+    return block;
+}
+
+bool AotProgram::add(const AotProgram &program) {
+    registry().push_back(&program);
+    return true;
+}
+
+const AotProgram *AotProgram::find(const byte *image, size_t size) {
+    for (const AotProgram *program : registry()) {
+        if (program->image_size == size && std::memcmp(program->image, image, size) == 0)
+            return program;
+    }
+    return nullptr;
+}
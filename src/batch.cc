@@ -0,0 +1,331 @@
+#include "cpu.h"
+#include "input_log.h"
+#include "lockstep.h"
+#include "pool.h"
+#include "trace_ring.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/// one manifest line: ROM, instruction budget and optional input script
+struct Job {
+    std::string rom;
+    uint64_t cycles;
+    std::string script;
+};
+
+/// command line settings shared by all jobs
+struct Settings {
+    uint32_t timer_ratio = Cpu::default_timer_ratio;
+    /// CXNN seed of every job
+    uint64_t seed = 0;
+    bool jit = false;
+    /// directory for traces of failed jobs, null to not trace
+    const char *trace_dir = nullptr;
+    /// jobs of one ROM run together in a Lockstep of this many lanes, 0 to
+    /// run every job on its own Cpu
+    size_t lanes = 0;
+};
+
+/// instructions kept per job with --trace
+static constexpr size_t trace_size = 16 << 10;
+
+/// per job outcome
+struct Result {
+    std::string error;
+    uint64_t instructions = 0;
+    uint64_t vram_hash = 0;
+    Cpu::Register reg = {};
+};
+
+static void usage() {
+    std::cout << "Usage: chip8_batch [--threads N] [--timer-ratio N] [--seed N] [--jit] [--trace DIR]\n"
+                 "                   [--lanes 8|16|32] MANIFEST\n\n"
+                 "Manifest lines: ROM CYCLES [INPUT_SCRIPT], '#' starts a comment.\n"
+                 "Input script lines: FRAME KEYMASK, keys are held from that frame on.\n"
+                 "An input log written by chip8 --record may be given instead, the job then\n"
+                 "uses its seed and timer ratio, and CYCLES 0 runs it for its logged length.\n"
+                 "With --trace the last instructions of a failed job N go to DIR/jobN.trace.\n"
+                 "--lanes runs jobs of the same ROM in lockstep, N per task, without --jit\n"
+                 "or --trace; a failed job reports the instructions before the failing one."
+              << std::endl;
+}
+
+static std::vector<Job> read_manifest(const char *file) {
+    std::ifstream stream(file);
+    if (!stream) {
+        throw std::runtime_error("could not open manifest");
+    }
+
+    std::vector<Job> jobs;
+    std::string line;
+    while (std::getline(stream, line)) {
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream fields(line);
+        Job job;
+        if (!(fields >> job.rom))
+            continue;
+        if (!(fields >> job.cycles))
+            throw std::runtime_error("manifest line without cycle budget: " + line);
+        fields >> job.script;
+
+        jobs.push_back(job);
+    }
+    return jobs;
+}
+
+/// FNV-1a over video memory rows, most significant byte first
+static uint64_t hash_vram(const uint64_t *vram) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t y = 0; y < Cpu::vram_height; y++) {
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            hash = (hash ^ byte(vram[y] >> shift)) * 0x100000001b3;
+        }
+    }
+    return hash;
+}
+
+/// input log of a job, recorded or read from a text script
+static InputLog read_input(const Job &job, const Settings &settings, bool &recorded) {
+    recorded = !job.script.empty() && InputLog::is_log(job.script.c_str());
+    if (job.script.empty())
+        return InputLog();
+    return recorded ? InputLog::read(job.script.c_str())
+                    : InputLog::read_script(job.script.c_str(), settings.timer_ratio);
+}
+
+static Result run_job(const Job &job, size_t index, const Settings &settings) {
+    Result result;
+    auto cpu = std::make_unique<Cpu>();
+    std::unique_ptr<TraceRing> trace;
+
+    try {
+        bool recorded;
+        InputLog log = read_input(job, settings, recorded);
+
+        cpu->set_seed(settings.seed);
+        cpu->load_program(job.rom.c_str());
+        cpu->set_timer_ratio(settings.timer_ratio);
+        if (recorded)
+            log.apply(*cpu);
+        cpu->set_jit(settings.jit);
+        if (settings.trace_dir) {
+            trace = std::make_unique<TraceRing>(trace_size);
+            cpu->set_trace(trace.get());
+        }
+
+        // key changes land on the instruction they were logged at
+        uint64_t cycles = (recorded && job.cycles == 0) ? log.length : job.cycles;
+        log.run(*cpu, cycles);
+    } catch (const std::exception &e) {
+        result.error = e.what();
+
+        if (trace && trace->pushed()) {
+            std::string file = std::string(settings.trace_dir) + "/job" + std::to_string(index) + ".trace";
+            if (!trace->write(file.c_str()))
+                fprintf(stderr, "could not write trace %s\n", file.c_str());
+        }
+    }
+
+    result.instructions = cpu->get_instructions();
+    result.vram_hash = hash_vram(cpu->get_vram());
+    result.reg = cpu->get_registers();
+    return result;
+}
+
+/// run jobs of one ROM in the lanes of a Lockstep, one job per lane
+template <size_t Lanes>
+static void run_lockstep(const std::vector<Job> &jobs, const std::vector<size_t> &group,
+                         std::vector<Result> &results, const Settings &settings) {
+    auto cpus = std::make_unique<Lockstep<Lanes>>();
+    std::vector<InputLog> logs(Lanes);
+    std::vector<uint64_t> cycles(Lanes);
+    std::vector<size_t> next(Lanes);
+
+    try {
+        cpus->load_program(jobs[group[0]].rom.c_str());
+    } catch (const std::exception &e) {
+        for (size_t index : group) {
+            results[index].error = e.what();
+        }
+        return;
+    }
+
+    // finished lanes keep running so the others are not split from them
+    std::vector<bool> finished(Lanes);
+    auto finish = [&](size_t lane) {
+        Result &result = results[group[lane]];
+        if (result.error.empty())
+            result.error = cpus->get_error(lane);
+        result.instructions = cpus->get_instructions(lane);
+        result.vram_hash = hash_vram(cpus->get_vram(lane));
+        result.reg = cpus->get_registers(lane);
+        finished[lane] = true;
+    };
+
+    for (size_t lane = 0; lane < group.size(); lane++) {
+        const Job &job = jobs[group[lane]];
+        try {
+            bool recorded;
+            logs[lane] = read_input(job, settings, recorded);
+            cpus->set_seed(lane, settings.seed);
+            cpus->set_timer_ratio(lane, settings.timer_ratio);
+            cycles[lane] = job.cycles;
+            if (recorded) {
+                if (!logs[lane].matches(cpus->get_ram(lane)))
+                    throw std::runtime_error("input log was recorded with another ROM");
+                cpus->set_seed(lane, logs[lane].seed);
+                cpus->set_timer_ratio(lane, logs[lane].timer_ratio);
+                if (job.cycles == 0)
+                    cycles[lane] = logs[lane].length;
+            }
+        } catch (const std::exception &e) {
+            results[group[lane]].error = e.what();
+            cpus->stop(lane);
+            finish(lane);
+        }
+    }
+
+    // run to the next key change or job end of any lane
+    for (uint64_t now = 0;;) {
+        uint64_t stop = UINT64_MAX;
+        for (size_t lane = 0; lane < group.size(); lane++) {
+            if (finished[lane])
+                continue;
+            if (cycles[lane] <= now || !(cpus->get_running() & (uint64_t(1) << lane))) {
+                finish(lane);
+                continue;
+            }
+
+            const std::vector<InputLog::Event> &events = logs[lane].get_events();
+            for (; next[lane] < events.size() && events[next[lane]].instruction <= now; next[lane]++) {
+                cpus->set_keys(lane, events[next[lane]].keys);
+            }
+            stop = std::min(stop, cycles[lane]);
+            if (next[lane] < events.size())
+                stop = std::min(stop, events[next[lane]].instruction);
+        }
+
+        if (stop == UINT64_MAX)
+            break;
+        cpus->run(stop - now);
+        now = stop;
+    }
+}
+
+/// job indices split by ROM into groups of at most lanes jobs, jobs of
+/// similar length are grouped as a group runs as long as its longest job
+static std::vector<std::vector<size_t>> group_jobs(const std::vector<Job> &jobs, size_t lanes) {
+    std::map<std::string, std::vector<size_t>> by_rom;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        by_rom[jobs[i].rom].push_back(i);
+    }
+
+    std::vector<std::vector<size_t>> groups;
+    for (auto &rom : by_rom) {
+        std::stable_sort(rom.second.begin(), rom.second.end(), [&](size_t a, size_t b) {
+            return jobs[a].cycles < jobs[b].cycles;
+        });
+        for (size_t first = 0; first < rom.second.size(); first += lanes) {
+            size_t last = std::min(first + lanes, rom.second.size());
+            groups.emplace_back(rom.second.begin() + first, rom.second.begin() + last);
+        }
+    }
+    return groups;
+}
+
+static void print_result(const Job &job, const Result &result) {
+    const Cpu::Register &reg = result.reg;
+
+    printf("%s\t%llu\t%016llx\tPC=%04X\tI=%04X\tSP=%02X\tV=",
+        job.rom.c_str(), (unsigned long long) result.instructions,
+        (unsigned long long) result.vram_hash, reg.pc, reg.i, reg.sp);
+    for (size_t i = 0; i < sizeof(reg.v); i++) {
+        printf("%02X", reg.v[i]);
+    }
+    printf("\t%s\n", result.error.empty() ? "ok" : result.error.c_str());
+}
+
+int main(int argc, char *argv[]) {
+    const char *manifest = nullptr;
+    size_t threads = std::thread::hardware_concurrency();
+    Settings settings;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = strtoul(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "--timer-ratio") && i + 1 < argc) {
+            settings.timer_ratio = strtoul(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            settings.seed = strtoull(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "--jit")) {
+            settings.jit = true;
+        } else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+            settings.trace_dir = argv[++i];
+        } else if (!strcmp(argv[i], "--lanes") && i + 1 < argc) {
+            settings.lanes = strtoul(argv[++i], nullptr, 0);
+        } else {
+            manifest = argv[i];
+        }
+    }
+
+    bool lanes_ok = settings.lanes == 0 || settings.lanes == 8 || settings.lanes == 16 || settings.lanes == 32;
+    if (!manifest || settings.timer_ratio == 0 || !lanes_ok) {
+        usage();
+        return 0;
+    }
+
+    std::vector<Job> jobs;
+    try {
+        jobs = read_manifest(manifest);
+    } catch (const std::exception &e) {
+        std::cerr << "error: " << e.what() << std::endl;
+        return 1;
+    }
+    std::vector<Result> results(jobs.size());
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(threads);
+        if (settings.lanes) {
+            for (const std::vector<size_t> &group : group_jobs(jobs, settings.lanes)) {
+                pool.submit([&, group] {
+                    switch (settings.lanes) {
+                        case 8: run_lockstep<8>(jobs, group, results, settings); break;
+                        case 16: run_lockstep<16>(jobs, group, results, settings); break;
+                        default: run_lockstep<32>(jobs, group, results, settings); break;
+                    }
+                });
+            }
+        } else {
+            for (size_t i = 0; i < jobs.size(); i++) {
+                pool.submit([&, i] { results[i] = run_job(jobs[i], i, settings); });
+            }
+        }
+        pool.wait();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    uint64_t total = 0;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        print_result(jobs[i], results[i]);
+        total += results[i].instructions;
+    }
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    fprintf(stderr, "%zu jobs, %llu instructions in %.1f ms (%.1f MIPS)\n",
+        jobs.size(), (unsigned long long) total, seconds * 1000.0, total / seconds / 1e6);
+
+    return 0;
+}
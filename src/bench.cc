@@ -0,0 +1,282 @@
+#include "cpu.h"
+#include "input_log.h"
+#include "random.h"
+#include "rom_image.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <initializer_list>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/// hand assembled program stressing one instruction class, a short setup
+/// followed by an endless loop
+struct Synthetic {
+    const char *name;
+    std::vector<byte> program;
+    /// instructions per loop iteration and DXYN among them
+    size_t loop_size;
+    size_t draws;
+    /// the same program without its DXYN, its loop time is taken off
+    /// ns_per_dxyn; empty without draws
+    std::vector<byte> baseline;
+};
+
+/// command line settings shared by all workloads
+struct Settings {
+    uint32_t timer_ratio = Cpu::default_timer_ratio;
+    bool jit = false;
+    /// instructions per synthetic workload run
+    uint64_t instructions = 50000000;
+    /// frames per render workload run
+    uint64_t frames = 1000000;
+    /// runs per workload, the fastest is reported
+    size_t repeat = 3;
+    /// ROM CYCLES [INPUT_SCRIPT] lines as for chip8_batch, null for none
+    const char *manifest = nullptr;
+};
+
+/// pixel colors of the window, see gui.h
+static constexpr uint32_t color_on = 0xff007939;
+static constexpr uint32_t color_off = 0xff000000;
+
+static void usage() {
+    std::cout << "Usage: chip8_bench [--timer-ratio N] [--jit] [--instructions N] [--frames N]\n"
+                 "                   [--repeat N] [MANIFEST]\n\n"
+                 "Runs synthetic ALU, DXYN and FX55/FX65 programs, the ROMs of MANIFEST\n"
+                 "(lines as for chip8_batch) and the window's pixel expansion, printing one\n"
+                 "JSON object per workload with the fastest of --repeat runs."
+              << std::endl;
+}
+
+/// opcodes to big endian program bytes
+static std::vector<byte> assemble(std::initializer_list<word> opcodes) {
+    std::vector<byte> program;
+    for (word opcode : opcodes) {
+        program.push_back(opcode >> 8);
+        program.push_back(opcode & 0xff);
+    }
+    return program;
+}
+
+static std::vector<Synthetic> synthetic_workloads() {
+    return {
+        // 8XYn arithmetic on changing values
+        { "alu", assemble({
+            0x6001, 0x6103, 0x6207, 0x630F,
+            0x8014, 0x8105, 0x8213, 0x8321, 0x8432, 0x8506, 0x850E, 0x8617, 0x8744, 0x8051,
+            0x1208,
+        }), 11, 0, {} },
+        // 15 row font sprites at four moving places, wrapping and clipping
+        { "dxyn", assemble({
+            0xA000, 0x6100, 0x6308, 0x6510, 0x6718,
+            0xD01F, 0xD23F, 0xD45F, 0xD67F, 0x7001, 0x7203, 0x7405, 0x7607,
+            0x120A,
+        }), 9, 4, assemble({
+            0xA000, 0x6100, 0x6308, 0x6510, 0x6718,
+            0x7001, 0x7203, 0x7405, 0x7607,
+            0x120A,
+        }) },
+        // FX65/FX55 round trips through data memory
+        { "memory", assemble({
+            0xA300, 0xFF65, 0x7001, 0xA300, 0xFF55,
+            0xA340, 0xF765, 0x7101, 0xA340, 0xF755,
+            0x1200,
+        }), 11, 0, {} },
+    };
+}
+
+/// JSON string literal of text
+static std::string quote(const std::string &text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+/// seconds of the fastest of repeat calls of run
+template <typename F>
+static double fastest(size_t repeat, F run) {
+    double best = 0;
+    for (size_t r = 0; r < repeat; r++) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (r == 0 || seconds < best)
+            best = seconds;
+    }
+    return best;
+}
+
+/// seconds of the fastest run of settings.instructions of program
+static double time_program(const std::vector<byte> &program, const Settings &settings) {
+    std::shared_ptr<const RomImage> image = RomImage::create(program.data(), program.size());
+    return fastest(settings.repeat, [&] {
+        auto cpu = std::make_unique<Cpu>();
+        cpu->load_program(image);
+        cpu->set_timer_ratio(settings.timer_ratio);
+        cpu->set_jit(settings.jit);
+        cpu->run(settings.instructions);
+    });
+}
+
+static void bench_synthetic(const Synthetic &workload, const Settings &settings) {
+    double seconds = time_program(workload.program, settings);
+
+    printf("{\"workload\": %s, \"kind\": \"synthetic\", \"jit\": %s, \"instructions\": %llu, "
+           "\"seconds\": %.6f, \"instructions_per_sec\": %.0f",
+        quote(workload.name).c_str(), settings.jit ? "true" : "false",
+        (unsigned long long) settings.instructions, seconds, settings.instructions / seconds);
+    if (workload.draws) {
+        // loop iterations with and without the draws, the difference is
+        // what the draws cost
+        double iterations = double(settings.instructions) / workload.loop_size;
+        double baseline_iterations = double(settings.instructions) / (workload.loop_size - workload.draws);
+        double draw_seconds = seconds / iterations - time_program(workload.baseline, settings) / baseline_iterations;
+        printf(", \"ns_per_dxyn\": %.2f", draw_seconds * 1e9 / workload.draws);
+    }
+    printf("}\n");
+}
+
+/// run one manifest line, ROM CYCLES [INPUT_SCRIPT]
+static void bench_rom(const std::string &line, const Settings &settings) {
+    std::istringstream fields(line);
+    std::string rom, script;
+    uint64_t cycles = 0;
+    if (!(fields >> rom))
+        return;
+    if (!(fields >> cycles))
+        throw std::runtime_error("manifest line without cycle budget: " + line);
+    fields >> script;
+
+    std::string error;
+    bool recorded = !script.empty() && InputLog::is_log(script.c_str());
+    InputLog log;
+    // read and decoded once, samples time only the run
+    std::shared_ptr<const RomImage> image;
+    try {
+        image = RomImage::load(rom.c_str());
+        if (!script.empty())
+            log = recorded ? InputLog::read(script.c_str()) : InputLog::read_script(script.c_str(), settings.timer_ratio);
+    } catch (const std::exception &e) {
+        error = e.what();
+    }
+    if (recorded && cycles == 0)
+        cycles = log.length;
+
+    uint64_t instructions = 0;
+    double seconds = 0;
+    if (error.empty()) {
+        seconds = fastest(settings.repeat, [&] {
+            auto cpu = std::make_unique<Cpu>();
+            InputLog replay = log;
+            cpu->load_program(image);
+            try {
+                cpu->set_timer_ratio(settings.timer_ratio);
+                if (recorded)
+                    replay.apply(*cpu);
+                cpu->set_jit(settings.jit);
+                replay.run(*cpu, cycles);
+            } catch (const std::exception &e) {
+                error = e.what();
+            }
+            instructions = cpu->get_instructions();
+        });
+    }
+
+    printf("{\"workload\": %s, \"kind\": \"rom\", \"jit\": %s, \"instructions\": %llu, "
+           "\"seconds\": %.6f, \"instructions_per_sec\": %.0f",
+        quote(rom).c_str(), settings.jit ? "true" : "false",
+        (unsigned long long) instructions, seconds, seconds > 0 ? instructions / seconds : 0.0);
+    if (!script.empty())
+        printf(", \"script\": %s", quote(script).c_str());
+    if (!error.empty())
+        printf(", \"error\": %s", quote(error).c_str());
+    printf("}\n");
+}
+
+/// full frames expanded to window pixels, as Gui::update_screen does when
+/// every row changed
+static void bench_render(const Settings &settings) {
+    uint64_t vram[Cpu::vram_height];
+    Random random;
+    for (uint64_t &row : vram) {
+        row = uint64_t(random()) << 32 | random();
+    }
+
+    std::vector<uint32_t> pixels(Cpu::vram_size);
+    uint64_t checksum = 0;
+    double seconds = fastest(settings.repeat, [&] {
+        for (uint64_t frame = 0; frame < settings.frames; frame++) {
+            for (size_t y = 0; y < Cpu::vram_height; y++) {
+                Cpu::expand_row<uint32_t>(vram[y] ^ frame, &pixels[y * Cpu::vram_width], color_on, color_off);
+            }
+            checksum += pixels[frame % Cpu::vram_size];
+        }
+    });
+
+    printf("{\"workload\": \"expand\", \"kind\": \"render\", \"frames\": %llu, "
+           "\"seconds\": %.6f, \"frames_per_sec\": %.0f, \"checksum\": %llu}\n",
+        (unsigned long long) settings.frames, seconds, settings.frames / seconds,
+        (unsigned long long) checksum);
+}
+
+int main(int argc, char *argv[]) {
+    Settings settings;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--timer-ratio") && i + 1 < argc) {
+            settings.timer_ratio = strtoul(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "--jit")) {
+            settings.jit = true;
+        } else if (!strcmp(argv[i], "--instructions") && i + 1 < argc) {
+            settings.instructions = strtoull(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            settings.frames = strtoull(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "--repeat") && i + 1 < argc) {
+            settings.repeat = strtoul(argv[++i], nullptr, 0);
+        } else if (argv[i][0] != '-' && !settings.manifest) {
+            settings.manifest = argv[i];
+        } else {
+            usage();
+            return 0;
+        }
+    }
+
+    if (settings.timer_ratio == 0 || settings.repeat == 0) {
+        usage();
+        return 0;
+    }
+
+    try {
+        for (const Synthetic &workload : synthetic_workloads()) {
+            bench_synthetic(workload, settings);
+        }
+
+        if (settings.manifest) {
+            std::ifstream stream(settings.manifest);
+            if (!stream) {
+                throw std::runtime_error("could not open manifest");
+            }
+            std::string line;
+            while (std::getline(stream, line)) {
+                bench_rom(line.substr(0, line.find('#')), settings);
+            }
+        }
+
+        bench_render(settings);
+    } catch (const std::exception &e) {
+        std::cerr << "error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
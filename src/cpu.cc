@@ -1,184 +1,545 @@
-#include "cpu.h"
-#include "opcode.h"
-#include <fstream>
-#include <algorithm>
-#include <stdexcept>
-
-/// start address of program (pc)
-static constexpr size_t prog_start = 0x200;
-/// max program size
-static constexpr size_t max_prog_size = (Cpu::mem_size - prog_start);
-
-/// cpu frequency
-static constexpr size_t cpu_frequency = 600;
-/// timer frequency
-static constexpr size_t timer_frequency = 60;
-
-/// cpu time out
-static constexpr float cpu_time_out = 1000.0 / float(cpu_frequency);
-/// timer time out
-static constexpr float timer_time_out = 1000.0 / float(timer_frequency);
-
-/// font sprite data ('0' - 'F')
-static uint8_t HEX_FONTS[] = {
-    0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-    0x20, 0x60, 0x20, 0x20, 0x70, // 1
-    0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-    0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-    0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-    0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-    0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-    0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-    0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-    0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-    0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-    0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-    0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-    0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-    0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-    0xF0, 0x80, 0xF0, 0x80, 0x80  // F
-};
-
-void Cpu::load_program(const char *file) {
-    std::ifstream stream(file, std::ios::binary);
-    
-    if (!stream) {
-        throw std::runtime_error("could not open file");
-    }
-
-    reset();
-
-    stream.read(reinterpret_cast<char*>(ram + prog_start), max_prog_size);
-}
-
-void Cpu::cycle(uint32_t now) {
-    if ((now - last_timer_ticks) > timer_time_out) {
-        if (delay_timer > 0)
-            delay_timer--;
-        if (sound_timer > 0)
-            sound_timer--;
-
-        last_timer_ticks = now;
-    }
-
-    if ((now - last_cpu_ticks) > cpu_time_out) {
-        word code = fetch();
-
-        update_gui = false;
-        interpret(code);
-
-        if (debug) {
-            dump_registers();
-        }
-
-        last_cpu_ticks = now;
-    }
-}
-
-void Cpu::reset() {
-    // clear memory and registers
-    std::fill_n(ram, sizeof(ram), 0);
-    std::fill_n(vram, sizeof(vram), 0);
-    std::fill_n(stack, sizeof(stack), 0);
-    std::fill_n(keys, sizeof(keys), 0);
-
-    reg = (const Register) {};
-    reg.pc = prog_start;
-
-    // reload fonts
-    std::copy_n(HEX_FONTS, sizeof(HEX_FONTS), ram);
-}
-
-word Cpu::fetch() {
-    word high = ram[reg.pc++] << 8;
-    word low = ram[reg.pc++];
-    return high | low; 
-}
-
-void Cpu::interpret(word opcode) {
-    byte type = (opcode & 0xf000) >> 12;
-    Opcode code = { word(opcode & 0x0fff) };
-
-    switch (type) {
-        case 0x00: {
-            if (code.low == 0xe0)
-                Operations::cls(*this);
-            else if (code.low == 0xee)
-                Operations::ret(*this);
-            // ignore others
-        } break;
-
-        case 0x01: Operations::jump(*this, code); break;
-        case 0x02: Operations::call(*this, code); break;
-        case 0x03: Operations::skip_eq(*this, code); break;
-        case 0x04: Operations::skip_not_eq(*this, code); break;
-
-        case 0x05: {
-            if (code.low & 0x0f)
-                throw std::runtime_error("invalid opcode: 5XY0");
-            Operations::skip_eq_reg(*this, code);
-        } break;
-
-        case 0x06: Operations::load_reg_value(*this, code); break;
-        case 0x07: Operations::add_reg_value(*this, code); break;
-
-        case 0x08: {
-            switch (code.low & 0x0f) {
-                case 0x00: Operations::load_reg_reg(*this, code); break;
-                case 0x01: Operations::or_reg_reg(*this, code); break;
-                case 0x02: Operations::and_reg_reg(*this, code); break;
-                case 0x03: Operations::xor_reg_reg(*this, code); break;
-                case 0x04: Operations::add_reg_reg(*this, code); break;
-                case 0x05: Operations::sub_reg_reg(*this, code); break;
-                case 0x06: Operations::shr_reg_reg(*this, code); break;
-                case 0x07: Operations::subn_reg_reg(*this, code); break;
-                case 0x0e: Operations::shl_reg_reg(*this, code); break;
-                default: throw std::runtime_error("invalid opcode: 8XYn");
-            }
-        } break;
-
-        case 0x09: Operations::skip_not_eq_reg(*this, code); break;
-        case 0x0a: Operations::load_i_addr(*this, code); break;
-        case 0x0b: Operations::jump_relative(*this, code); break;
-        case 0x0c: Operations::rand_mask(*this, code); break;
-        case 0x0d: Operations::draw_sprite(*this, code); break;
-
-        case 0x0e: {
-            if (code.low == 0x9e)
-                Operations::skip_pressed(*this, code);
-            else if (code.low == 0xa1)
-                Operations::skip_not_pressed(*this, code);
-            else
-                throw std::runtime_error("invalid opcode: EXnn");
-        } break;
-
-        case 0x0f: {
-            switch (code.low) {
-                case 0x07: Operations::load_reg_delay(*this, code); break;
-                case 0x0A: Operations::load_wait_key(*this, code); break;
-                case 0x15: Operations::load_delay_reg(*this, code); break;
-                case 0x18: Operations::load_sound_reg(*this, code); break;
-                case 0x1E: Operations::add_i_reg(*this, code); break;
-                case 0x29: Operations::load_sprite(*this, code); break;
-                case 0x33: Operations::store_bcd(*this, code); break;
-                case 0x55: Operations::store_regs(*this, code); break;
-                case 0x65: Operations::load_regs(*this, code); break;
-                default: throw std::runtime_error("invalid opcode: FXnn");
-            }
-        } break;
-
-        default: throw std::runtime_error("impossible!!!");
-    }
-}
-
-#include <cstdio>
-
-void Cpu::dump_registers() {
-    for (size_t i = 0; i < sizeof(reg.v); i++) {
-        printf("V%llX: %02X\t", i, reg.v[i]);
-        if (i == sizeof(reg.v) / 2 - 1) 
-            printf("\n");
-    }
-    printf("\nI: %04X    SP: %04x    PC: %04x    DT: %04x    ST: %04x\n\n",
-        reg.i, reg.sp, reg.pc, delay_timer, sound_timer);
-}
+#include "cpu.h"
+#include "opcode.h"
+#include "jit.h"
+#include "aot.h"
+#include "debugger.h"
+#include "profile.h"
+#include "rom_image.h"
+#include "state_hash.h"
+#include "trace_ring.h"
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+/// save state magic
+static constexpr char state_magic[4] = { 'C', '8', 'S', 'S' };
+
+const size_t Cpu::state_size = sizeof(state_magic) + sizeof(state_version)
+    + sizeof(word) * 2 + sizeof(byte) + 16                    // pc, i, sp, v
+    + mem_size + sizeof(uint64_t) * vram_height + sizeof(word) * stack_size
+    + sizeof(uint16_t) + sizeof(byte) * 2                     // keys, timers
+    + sizeof(uint32_t) * 3 + sizeof(uint64_t)                 // dirty rows, ratio, countdown, instructions
+    + sizeof(uint64_t);                                       // rng
+
+/// decode cache page of misses without tracing, shared by pages that do
+/// not decode like the image, entries get private when executed
+static const Instruction *untraced_misses() {
+    static const std::vector<Instruction> page = [] {
+        Instruction miss = {};
+        miss.exec = Operations::decode_entry<NoTrace>;
+        return std::vector<Instruction>(Cpu::page_size / 2, miss);
+    }();
+    return page.data();
+}
+
+/// append raw bytes to a save state
+static byte *put(byte *out, const void *data, size_t size) {
+    std::memcpy(out, data, size);
+    return out + size;
+}
+
+/// take raw bytes from a save state
+static const byte *get(const byte *in, void *data, size_t size) {
+    std::memcpy(data, in, size);
+    return in + size;
+}
+
+Cpu::Cpu() : image(RomImage::blank()) {
+    for (size_t page = 0; page < page_count; page++) {
+        pages[page].ram = image->ram + page * page_size;
+    }
+    select_policy();
+    reset();
+}
+
+Cpu::~Cpu() {
+}
+
+void Cpu::load_program(const char *file) {
+    load_program(RomImage::load(file));
+}
+
+void Cpu::load_program(const byte *program, size_t size) {
+    load_program(RomImage::create(program, size));
+}
+
+void Cpu::load_program(std::shared_ptr<const RomImage> image) {
+    this->image = std::move(image);
+    aot = this->image->aot;
+    reset();
+}
+
+Cpu::Frame Cpu::run_frame() {
+    Frame frame;
+    uint64_t start = instructions;
+
+    run(timer_countdown);
+
+    frame.instructions = instructions - start;
+    frame.dirty_rows = take_dirty_rows();
+    frame.sound = sound_timer > 0;
+    return frame;
+}
+
+void Cpu::run(uint64_t count) {
+    while (count > 0) {
+        uint32_t slice = std::min<uint64_t>(count, timer_countdown);
+
+        budget = slice;
+        try {
+            (this->*run_fn)();
+        } catch (...) {
+            // count what ran before the failing instruction, it took
+            // itself off the budget but did not complete
+            slice -= budget + 1;
+            instructions += slice;
+            timer_countdown -= slice;
+            throw;
+        }
+        // budget is left only when the debugger stopped the slice
+        slice -= budget;
+
+        instructions += slice;
+        count -= slice;
+        timer_countdown -= slice;
+        if (timer_countdown == 0) {
+            tick_timers();
+            timer_countdown = timer_ratio;
+        }
+        if (budget)
+            return;
+    }
+}
+
+void Cpu::save_state(byte *out) const {
+    uint16_t version = state_version;
+    uint16_t key_bits = 0;
+    for (size_t i = 0; i < key_size; i++) {
+        key_bits |= uint16_t(keys[i]) << i;
+    }
+
+    out = put(out, state_magic, sizeof(state_magic));
+    out = put(out, &version, sizeof(version));
+    out = put(out, &reg.pc, sizeof(reg.pc));
+    out = put(out, &reg.i, sizeof(reg.i));
+    out = put(out, &reg.sp, sizeof(reg.sp));
+    out = put(out, reg.v, sizeof(reg.v));
+    for (size_t page = 0; page < page_count; page++) {
+        out = put(out, pages[page].ram, page_size);
+    }
+    out = put(out, vram, sizeof(vram));
+    out = put(out, stack, sizeof(stack));
+    out = put(out, &key_bits, sizeof(key_bits));
+    out = put(out, &delay_timer, sizeof(delay_timer));
+    out = put(out, &sound_timer, sizeof(sound_timer));
+    out = put(out, &dirty_rows, sizeof(dirty_rows));
+    out = put(out, &timer_ratio, sizeof(timer_ratio));
+    out = put(out, &timer_countdown, sizeof(timer_countdown));
+    out = put(out, &instructions, sizeof(instructions));
+    out = put(out, &rng.state, sizeof(rng.state));
+}
+
+std::vector<byte> Cpu::save_state() const {
+    std::vector<byte> state(state_size);
+    save_state(state.data());
+    return state;
+}
+
+void Cpu::load_state(const byte *in, size_t size) {
+    char magic[sizeof(state_magic)];
+    uint16_t version;
+    uint16_t key_bits;
+
+    if (size != state_size) {
+        throw std::runtime_error("invalid save state size");
+    }
+    // a corrupt state resets with the ratio the cpu had
+    uint32_t ratio = timer_ratio;
+    in = get(in, magic, sizeof(magic));
+    in = get(in, &version, sizeof(version));
+    if (std::memcmp(magic, state_magic, sizeof(magic)) || version != state_version) {
+        throw std::runtime_error("unsupported save state");
+    }
+
+    in = get(in, &reg.pc, sizeof(reg.pc));
+    in = get(in, &reg.i, sizeof(reg.i));
+    in = get(in, &reg.sp, sizeof(reg.sp));
+    in = get(in, reg.v, sizeof(reg.v));
+    // pages equal to the image stay shared
+    for (size_t page = 0; page < page_count; page++) {
+        const byte *shared = image->ram + page * page_size;
+        if (std::memcmp(in, shared, page_size) == 0)
+            pages[page].ram = shared;
+        else
+            std::memcpy(own_page(page), in, page_size);
+        in += page_size;
+    }
+    in = get(in, vram, sizeof(vram));
+    in = get(in, stack, sizeof(stack));
+    in = get(in, &key_bits, sizeof(key_bits));
+    in = get(in, &delay_timer, sizeof(delay_timer));
+    in = get(in, &sound_timer, sizeof(sound_timer));
+    in = get(in, &dirty_rows, sizeof(dirty_rows));
+    in = get(in, &timer_ratio, sizeof(timer_ratio));
+    in = get(in, &timer_countdown, sizeof(timer_countdown));
+    in = get(in, &instructions, sizeof(instructions));
+    in = get(in, &rng.state, sizeof(rng.state));
+
+    for (size_t i = 0; i < key_size; i++) {
+        keys[i] = (key_bits >> i) & 1;
+    }
+    hash_rows = ~uint32_t(0);
+    hash_pages = ~uint16_t(0);
+
+    if (reg.sp > stack_size || timer_ratio == 0 || timer_countdown == 0 || timer_countdown > timer_ratio) {
+        timer_ratio = ratio;
+        reset();
+        throw std::runtime_error("corrupt save state");
+    }
+
+    if (jit)
+        jit->invalidate(0, mem_size);
+    map_decoded();
+}
+
+void Cpu::tick_timers() {
+    if (delay_timer > 0)
+        delay_timer--;
+    if (sound_timer > 0)
+        sound_timer--;
+}
+
+void Cpu::reset() {
+    // memory goes back to the image, clear registers
+    for (size_t page = 0; page < page_count; page++) {
+        pages[page].ram = image->ram + page * page_size;
+    }
+    std::fill_n(vram, vram_height, 0);
+    std::fill_n(stack, stack_size, 0);
+    std::fill_n(keys, key_size, 0);
+
+    reg = (const Register) {};
+    reg.pc = RomImage::program_start;
+
+    delay_timer = 0;
+    sound_timer = 0;
+    dirty_rows = ~uint32_t(0);
+    hash_rows = ~uint32_t(0);
+    hash_pages = ~uint16_t(0);
+    instructions = 0;
+    timer_countdown = timer_ratio;
+
+    rng.seed(seed);
+
+    if (jit)
+        jit->invalidate(0, mem_size);
+    map_decoded();
+}
+
+word Cpu::fetch() {
+    word high = read(reg.pc++) << 8;
+    word low = read(reg.pc++);
+    return high | low; 
+}
+
+template <typename Trace>
+void Cpu::step() {
+    if (Trace::profile || Trace::record) {
+        word pc = reg.pc & (mem_size - 1);
+        word opcode = read(pc) << 8 | read(pc + 1);
+        if (Trace::profile)
+            profiler->record(pc, opcode);
+        if (Trace::record)
+            trace->push(reg.pc, opcode, reg.i, reg.v);
+    }
+
+    // odd addresses are not cached, decode on the fly
+    if (reg.pc & 1) {
+        Instruction ins = Operations::decode<Trace>(fetch());
+        ins.exec(*this, ins);
+    } else {
+        const Instruction &ins = current_entry(reg.pc & (mem_size - 1));
+        reg.pc += 2;
+        ins.exec(*this, ins);
+    }
+
+    if (Trace::print) {
+        dump_registers();
+    }
+}
+
+template <typename Trace>
+void Cpu::run_slice() {
+    while (budget > 0) {
+        if (Trace::watch && (debugger->stopped() || debugger->check_break(reg)))
+            return;
+        budget--;
+        step<Trace>();
+    }
+}
+
+template void Cpu::run_slice<NoTrace>();
+template void Cpu::run_slice<PrintTrace>();
+template void Cpu::run_slice<ProfileTrace>();
+template void Cpu::run_slice<RingTrace>();
+template void Cpu::run_slice<WatchTrace>();
+
+void Cpu::interpret(word opcode) {
+    Instruction ins = debug ? Operations::decode<PrintTrace>(opcode)
+                    : debugger ? Operations::decode<WatchTrace>(opcode)
+                    : profiler ? Operations::decode<ProfileTrace>(opcode)
+                    : trace ? Operations::decode<RingTrace>(opcode)
+                    : Operations::decode<NoTrace>(opcode);
+    ins.exec(*this, ins);
+}
+
+void Cpu::set_debug(bool debug) {
+    this->debug = debug;
+    select_policy();
+}
+
+void Cpu::set_debugger(Debugger *debugger) {
+    this->debugger = debugger;
+    select_policy();
+}
+
+void Cpu::set_profiler(Profiler *profiler) {
+    this->profiler = profiler;
+    select_policy();
+}
+
+void Cpu::set_trace(TraceRing *trace) {
+    this->trace = trace;
+    select_policy();
+}
+
+void Cpu::select_policy() {
+    if (debug) {
+        run_fn = &Cpu::run_slice<PrintTrace>;
+        decode_miss = Operations::decode_entry<PrintTrace>;
+    } else if (debugger) {
+        run_fn = &Cpu::run_slice<WatchTrace>;
+        decode_miss = Operations::decode_entry<WatchTrace>;
+    } else if (profiler) {
+        run_fn = &Cpu::run_slice<ProfileTrace>;
+        decode_miss = Operations::decode_entry<ProfileTrace>;
+    } else if (trace) {
+        run_fn = &Cpu::run_slice<RingTrace>;
+        decode_miss = Operations::decode_entry<RingTrace>;
+    } else {
+        run_fn = &Cpu::run_slice<NoTrace>;
+        decode_miss = Operations::decode_entry<NoTrace>;
+    }
+
+    // cached handlers belong to the previous instantiation
+    map_decoded();
+}
+
+void Cpu::set_jit(bool enable) {
+    if (enable && !jit) {
+        jit.reset(new Jit);
+    } else if (!enable) {
+        jit.reset();
+    }
+
+    // block entries in the decode cache belong to the previous translator
+    map_decoded();
+}
+
+void Cpu::set_aot(const AotProgram *program) {
+    aot = program;
+
+    // cached entries may run blocks of the previous program
+    map_decoded();
+}
+
+void Cpu::set_seed(uint64_t seed) {
+    this->seed = seed;
+    rng.seed(seed);
+}
+
+void Cpu::set_timer_ratio(uint32_t ratio) {
+    if (ratio == 0) {
+        throw std::runtime_error("timer ratio must be positive");
+    }
+
+    // a frame that has not started yet takes the new length
+    timer_countdown = timer_countdown == timer_ratio ? ratio : std::min(timer_countdown, ratio);
+    timer_ratio = ratio;
+}
+
+void Cpu::invalidate(size_t addr, size_t len) {
+    // a range past the end of memory continues at 0
+    addr &= mem_size - 1;
+    if (addr + len > mem_size) {
+        invalidate(0, addr + len - mem_size);
+        len = mem_size - addr;
+    }
+
+    // entries before addr may cover it, dropped blocks may start further back
+    size_t from = jit ? jit->invalidate(addr, len) : addr;
+    if (aot && addr < aot->origin + aot->image_size && addr + len > aot->origin) {
+        size_t reach = aot->max_block_size;
+        from = std::min(from, addr >= reach ? addr - reach + 1 : 0);
+    }
+    size_t first = (from >= max_decode_span ? from - max_decode_span + 1 : 0) >> 1;
+    size_t last = std::min((addr + len - 1) >> 1, mem_size / 2 - 1);
+
+    static constexpr size_t page_entries = page_size / 2;
+    for (size_t i = first; i <= last;) {
+        size_t page = i / page_entries;
+        size_t end = std::min(last + 1, (page + 1) * page_entries);
+        Instruction *own = own_decoded[page].get();
+        if (pages[page].decoded != own) {
+            // shared pages decode without tracing, drop the whole page so
+            // data the program writes costs no private entries
+            map_page(page, untraced_misses());
+            i = end;
+            continue;
+        }
+        for (; i < end; i++) {
+            own[i - page * page_entries].exec = decode_miss;
+        }
+    }
+}
+
+byte *Cpu::copy_page(size_t page) {
+    if (!own_ram[page])
+        own_ram[page].reset(new byte[page_size]);
+    byte *own = own_ram[page].get();
+    std::memcpy(own, pages[page].ram, page_size);
+    pages[page].ram = own;
+    return own;
+}
+
+Instruction &Cpu::own_entry(size_t addr) {
+    addr &= mem_size - 1;
+    Instruction *own = own_decoded_page(addr >> page_bits, true);
+    return own[(addr & (page_size - 1)) >> 1];
+}
+
+Instruction *Cpu::own_decoded_page(size_t page, bool copy) {
+    static constexpr size_t page_entries = page_size / 2;
+    if (!own_decoded[page])
+        own_decoded[page].reset(new Instruction[page_entries]);
+    Instruction *own = own_decoded[page].get();
+    if (pages[page].decoded != own) {
+        if (copy)
+            std::copy_n(pages[page].decoded, page_entries, own);
+        map_page(page, own);
+    }
+    return own;
+}
+
+void Cpu::map_decoded() {
+    static constexpr size_t page_entries = page_size / 2;
+    // the image decodes like a cpu without tracing, translator and other
+    // compiled program
+    bool shareable = decode_miss == Operations::decode_entry<NoTrace> && !jit && aot == image->aot;
+    size_t span = decode_span();
+
+    for (size_t page = 0; page < page_count; page++) {
+        // entries depend on the page and span bytes after it
+        bool shared = shareable;
+        size_t end = std::min(mem_size, (page + 1) * page_size + span - 1);
+        for (size_t other = page; other * page_size < end && shared; other++) {
+            shared = pages[other].ram == image->ram + other * page_size;
+        }
+
+        if (shared) {
+            map_page(page, image->decoded + page * page_entries);
+        } else if (decode_miss == Operations::decode_entry<NoTrace>) {
+            map_page(page, untraced_misses());
+        } else {
+            Instruction *own = own_decoded_page(page, false);
+            for (size_t i = 0; i < page_entries; i++) {
+                own[i].exec = decode_miss;
+            }
+        }
+    }
+}
+
+size_t Cpu::decode_span() const {
+    size_t span = max_decode_span;
+    if (jit)
+        span = std::max(span, Jit::max_span);
+    if (aot)
+        span = std::max(span, aot->max_block_size);
+    return span;
+}
+
+void Cpu::copy_ram(byte *out) const {
+    for (size_t page = 0; page < page_count; page++) {
+        std::memcpy(out + page * page_size, pages[page].ram, page_size);
+    }
+}
+
+const byte *Cpu::view(size_t addr, size_t len) const {
+    size_t end = std::min(mem_size, addr + len);
+    size_t first = addr >> page_bits;
+    size_t last = (end - 1) >> page_bits;
+
+    bool shared = true;
+    for (size_t page = first; page <= last && shared; page++) {
+        shared = pages[page].ram == image->ram + page * page_size;
+    }
+    if (shared)
+        return image->ram;
+
+    // gather the range where decoders look for it
+    thread_local byte scratch[mem_size];
+    for (size_t page = first; page <= last; page++) {
+        std::memcpy(scratch + page * page_size, pages[page].ram, page_size);
+    }
+    return scratch;
+}
+
+uint64_t Cpu::state_hash() {
+    // pages are seeded with their number, video memory and registers
+    // with the numbers after them
+    for (size_t page = 0; page < page_count; page++) {
+        if (!(hash_pages & (1 << page)))
+            continue;
+        const byte *shared = image->ram + page * page_size;
+        page_hashes[page] = pages[page].ram == shared ? image->page_hashes[page]
+                                                      : StateHash::bytes(pages[page].ram, page_size, page);
+    }
+    hash_pages = 0;
+    if (hash_rows) {
+        vram_hash = StateHash::bytes(reinterpret_cast<const byte*>(vram), sizeof(vram), page_count);
+        hash_rows = 0;
+    }
+
+    // registers packed without padding, stack entries above sp are dead
+    byte state[64 + sizeof(stack)];
+    byte *out = state;
+    out = put(out, &reg.pc, sizeof(reg.pc));
+    out = put(out, &reg.i, sizeof(reg.i));
+    out = put(out, &reg.sp, sizeof(reg.sp));
+    out = put(out, reg.v, sizeof(reg.v));
+    out = put(out, &delay_timer, sizeof(delay_timer));
+    out = put(out, &sound_timer, sizeof(sound_timer));
+    out = put(out, &timer_ratio, sizeof(timer_ratio));
+    out = put(out, &timer_countdown, sizeof(timer_countdown));
+    out = put(out, &rng.state, sizeof(rng.state));
+    out = put(out, stack, reg.sp * sizeof(stack[0]));
+
+    uint64_t hash = vram_hash ^ StateHash::bytes(state, out - state, page_count + 1);
+    for (size_t page = 0; page < page_count; page++) {
+        hash ^= page_hashes[page];
+    }
+    return StateHash::mix(hash);
+}
+
+#include <cstdio>
+
+void Cpu::dump_registers() {
+    for (size_t i = 0; i < sizeof(reg.v); i++) {
+        printf("V%X: %02X\t", unsigned(i), reg.v[i]);
+        if (i == sizeof(reg.v) / 2 - 1) 
+            printf("\n");
+    }
+    printf("\nI: %04X    SP: %04x    PC: %04x    DT: %04x    ST: %04x\n\n",
+        reg.i, reg.sp, reg.pc, delay_timer, sound_timer);
+}
@@ -0,0 +1,181 @@
+#include "debugger.h"
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+/// number at the start of text (0x for hex), moves text past it, throws
+/// if there is none or it exceeds max
+static unsigned long take_number(const char *&text, unsigned long max, const char *spec) {
+    char *end;
+    unsigned long value = strtoul(text, &end, 0);
+    if (end == text || value > max)
+        throw std::runtime_error(std::string("bad number in ") + spec);
+    text = end;
+    return value;
+}
+
+size_t Debugger::add_breakpoint(word addr) {
+    return add(Breakpoint{ addr, false, 0, equal, 0 });
+}
+
+size_t Debugger::add_breakpoint(word addr, byte reg, Compare compare, word value) {
+    if (reg > reg_i) {
+        throw std::runtime_error("invalid breakpoint register");
+    }
+    return add(Breakpoint{ addr, true, reg, compare, value });
+}
+
+size_t Debugger::add(const Breakpoint &breakpoint) {
+    if (breakpoint.addr >= Cpu::mem_size) {
+        throw std::runtime_error("breakpoint outside memory");
+    }
+    armed[breakpoint.addr] = true;
+    breakpoints.push_back(breakpoint);
+    return breakpoints.size() - 1;
+}
+
+size_t Debugger::add_watchpoint(word addr, word length, unsigned access) {
+    if (addr >= Cpu::mem_size || length == 0 || length > Cpu::mem_size || !(access & (read | write))) {
+        throw std::runtime_error("invalid watchpoint");
+    }
+    watchpoints.push_back(Watchpoint{ addr, length, access });
+    return watchpoints.size() - 1;
+}
+
+size_t Debugger::add_breakpoint(const char *spec) {
+    const char *text = spec;
+    word addr = take_number(text, Cpu::mem_size - 1, spec);
+    if (!*text)
+        return add_breakpoint(addr);
+    if (*text++ != ':')
+        throw std::runtime_error(std::string("bad breakpoint ") + spec);
+
+    byte reg;
+    if (toupper(*text) == 'I') {
+        reg = reg_i;
+        text++;
+    } else if (toupper(*text) == 'V' && isxdigit(text[1])) {
+        char digit = toupper(text[1]);
+        reg = isdigit(digit) ? digit - '0' : digit - 'A' + 10;
+        text += 2;
+    } else {
+        throw std::runtime_error(std::string("bad breakpoint register in ") + spec);
+    }
+
+    Compare compare;
+    if (!strncmp(text, "==", 2)) {
+        compare = equal;
+        text += 2;
+    } else if (!strncmp(text, "!=", 2)) {
+        compare = not_equal;
+        text += 2;
+    } else if (*text == '<') {
+        compare = less;
+        text++;
+    } else if (*text == '>') {
+        compare = greater;
+        text++;
+    } else {
+        throw std::runtime_error(std::string("bad breakpoint comparison in ") + spec);
+    }
+
+    word value = take_number(text, reg == reg_i ? 0xffff : 0xff, spec);
+    if (*text)
+        throw std::runtime_error(std::string("bad breakpoint ") + spec);
+    return add_breakpoint(addr, reg, compare, value);
+}
+
+size_t Debugger::add_watchpoint(const char *spec) {
+    const char *text = spec;
+    word addr = take_number(text, Cpu::mem_size - 1, spec);
+    word length = 1;
+    unsigned access = read | write;
+
+    if (*text == ':' && isdigit(text[1])) {
+        text++;
+        length = take_number(text, Cpu::mem_size, spec);
+    }
+    if (*text == ':') {
+        text++;
+        access = 0;
+        for (; *text == 'r' || *text == 'w'; text++) {
+            access |= *text == 'r' ? read : write;
+        }
+    }
+    if (*text)
+        throw std::runtime_error(std::string("bad watchpoint ") + spec);
+    return add_watchpoint(addr, length, access);
+}
+
+void Debugger::clear() {
+    breakpoints.clear();
+    watchpoints.clear();
+    armed.reset();
+}
+
+void Debugger::resume() {
+    // step over the breakpoint stopped at, it fires again next time
+    if (has_hit && hit.kind == Hit::breakpoint) {
+        skip_armed = true;
+        skip_pc = hit.pc;
+    }
+    has_hit = false;
+}
+
+void Debugger::print_hit(FILE *out) const {
+    if (!has_hit)
+        return;
+    if (hit.kind == Hit::breakpoint) {
+        fprintf(out, "break at 0x%04X (breakpoint %zu)\n", hit.pc, hit.index);
+    } else {
+        fprintf(out, "%s 0x%04X by 0x%04X (watchpoint %zu)\n", hit.kind == Hit::read ? "read" : "write",
+                hit.addr, hit.pc, hit.index);
+    }
+}
+
+bool Debugger::check_conditions(const Cpu::Register &reg, word pc) {
+    for (size_t k = 0; k < breakpoints.size(); k++) {
+        const Breakpoint &breakpoint = breakpoints[k];
+        if (breakpoint.addr != pc)
+            continue;
+
+        bool holds = true;
+        if (breakpoint.conditional) {
+            word value = breakpoint.reg == reg_i ? reg.i : reg.v[breakpoint.reg];
+            switch (breakpoint.compare) {
+                case equal: holds = value == breakpoint.value; break;
+                case not_equal: holds = value != breakpoint.value; break;
+                case less: holds = value < breakpoint.value; break;
+                case greater: holds = value > breakpoint.value; break;
+            }
+        }
+        if (holds) {
+            hit = Hit{ Hit::breakpoint, k, pc, pc };
+            has_hit = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Debugger::check_watchpoints(const Cpu::Register &reg, size_t addr, size_t length, Access access) {
+    for (size_t k = 0; k < watchpoints.size(); k++) {
+        const Watchpoint &watch = watchpoints[k];
+        if (!(watch.access & access))
+            continue;
+
+        for (size_t n = 0; n < length; n++) {
+            // distance past the watched address, wrapping like the access
+            size_t offset = (addr + n - watch.addr) & (Cpu::mem_size - 1);
+            if (offset < watch.length) {
+                word pc = (reg.pc - 2) & (Cpu::mem_size - 1);
+                word at = (addr + n) & (Cpu::mem_size - 1);
+                hit = Hit{ access == read ? Hit::read : Hit::write, k, pc, at };
+                has_hit = true;
+                return;
+            }
+        }
+    }
+}
@@ -0,0 +1,131 @@
+#include "env.h"
+#include "lockstep.h"
+#include "pool.h"
+#include "rom_image.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+VectorEnv::VectorEnv(const char *rom, const Config &config) : VectorEnv(RomImage::load(rom), config) {
+}
+
+VectorEnv::VectorEnv(std::shared_ptr<const RomImage> rom, const Config &config)
+    : config(config), frames(config.count), episodes(config.count), errors(config.count) {
+    if (config.count == 0 || config.frame_skip == 0 || config.timer_ratio == 0) {
+        throw std::runtime_error("instance count, frame skip and timer ratio must be positive");
+    }
+
+    for (size_t first = 0; first < config.count; first += lanes) {
+        auto cpus = std::make_unique<Lockstep<lanes>>();
+        // ratio before load so every lane starts a full frame from reset
+        for (size_t lane = 0; lane < lanes; lane++) {
+            cpus->set_timer_ratio(lane, config.timer_ratio);
+            cpus->set_seed(lane, config.seed + first + lane);
+        }
+        cpus->load_program(rom);
+
+        // lanes past the last instance never run
+        for (size_t lane = config.count - first; lane < lanes; lane++) {
+            cpus->stop(lane);
+        }
+        blocks.push_back(std::move(cpus));
+    }
+
+    if (config.threads > 1 && blocks.size() > 1) {
+        pool = std::make_unique<ThreadPool>(std::min(config.threads, blocks.size()));
+    }
+}
+
+VectorEnv::~VectorEnv() {
+}
+
+size_t VectorEnv::observation_size() const {
+    return config.observation == Observation::packed ? sizeof(uint64_t) * Cpu::vram_height : Cpu::vram_size;
+}
+
+void VectorEnv::reset(byte *observations) {
+    size_t size = observation_size();
+    for (size_t env = 0; env < config.count; env++) {
+        episodes[env] = 0;
+        errors[env].clear();
+        restart(env);
+        observe(env, observations + env * size);
+    }
+}
+
+void VectorEnv::step(const uint16_t *actions, byte *observations, byte *done) {
+    if (!pool) {
+        step_blocks(0, blocks.size(), actions, observations, done);
+        return;
+    }
+
+    // one task per worker, blocks of a task are contiguous instances
+    size_t tasks = pool->size();
+    for (size_t task = 0; task < tasks; task++) {
+        size_t first = blocks.size() * task / tasks;
+        size_t last = blocks.size() * (task + 1) / tasks;
+        pool->submit([=] { step_blocks(first, last, actions, observations, done); });
+    }
+    pool->wait();
+}
+
+void VectorEnv::step_blocks(size_t first, size_t last, const uint16_t *actions, byte *observations, byte *done) {
+    size_t size = observation_size();
+    uint64_t count = uint64_t(config.frame_skip) * config.timer_ratio;
+
+    for (size_t block = first; block < last; block++) {
+        Lockstep<lanes> &cpus = *blocks[block];
+        size_t base = block * lanes;
+        size_t used = std::min(lanes, config.count - base);
+
+        for (size_t lane = 0; lane < used; lane++) {
+            cpus.set_keys(lane, actions[base + lane]);
+        }
+        cpus.run(count);
+
+        for (size_t lane = 0; lane < used; lane++) {
+            size_t env = base + lane;
+            frames[env] += config.frame_skip;
+
+            bool failed = !(cpus.get_running() & (Lockstep<lanes>::Mask(1) << lane));
+            bool over = failed || (config.max_frames && frames[env] >= config.max_frames);
+            if (done)
+                done[env] = over;
+            if (over) {
+                errors[env] = cpus.get_error(lane);
+                episodes[env]++;
+                restart(env);
+            }
+            observe(env, observations + env * size);
+        }
+    }
+}
+
+void VectorEnv::restart(size_t env) {
+    Lockstep<lanes> &cpus = *blocks[env / lanes];
+    size_t lane = env % lanes;
+
+    cpus.set_seed(lane, config.seed + env + episodes[env] * config.count);
+    cpus.reset(lane);
+    frames[env] = 0;
+}
+
+void VectorEnv::observe(size_t env, byte *out) const {
+    const uint64_t *vram = blocks[env / lanes]->get_vram(env % lanes);
+
+    if (config.observation == Observation::packed) {
+        std::memcpy(out, vram, sizeof(uint64_t) * Cpu::vram_height);
+        return;
+    }
+    for (size_t y = 0; y < Cpu::vram_height; y++) {
+        Cpu::expand_row<byte>(vram[y], out + y * Cpu::vram_width, 1, 0);
+    }
+}
+
+const byte *VectorEnv::get_ram(size_t env) const {
+    return blocks[env / lanes]->get_ram(env % lanes);
+}
+
+byte VectorEnv::get_sound_timer(size_t env) const {
+    return blocks[env / lanes]->get_sound_timer(env % lanes);
+}
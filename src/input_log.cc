@@ -0,0 +1,194 @@
+#include "input_log.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+/// log file magic
+static constexpr char log_magic[4] = { 'C', '8', 'I', 'N' };
+
+// file layout, host byte order: magic, version (u16), seed (u64), timer
+// ratio (u32), rom hash (u64), length (u64), event count (u32), then per
+// event the instructions since the previous one as LEB128 and keys (u16)
+
+/// FNV-1a over memory
+static uint64_t hash_ram(const byte *ram) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < Cpu::mem_size; i++) {
+        hash = (hash ^ ram[i]) * 0x100000001b3;
+    }
+    return hash;
+}
+
+void InputLog::begin(const Cpu &cpu) {
+    seed = cpu.get_seed();
+    timer_ratio = cpu.get_timer_ratio();
+    byte ram[Cpu::mem_size];
+    cpu.copy_ram(ram);
+    rom_hash = hash_ram(ram);
+    length = 0;
+    events.clear();
+    next = 0;
+}
+
+bool InputLog::matches(const byte *ram) const {
+    return hash_ram(ram) == rom_hash;
+}
+
+void InputLog::apply(Cpu &cpu) const {
+    byte ram[Cpu::mem_size];
+    cpu.copy_ram(ram);
+    if (!matches(ram)) {
+        throw std::runtime_error("input log was recorded with another ROM");
+    }
+
+    cpu.set_seed(seed);
+    cpu.set_timer_ratio(timer_ratio);
+}
+
+void InputLog::add(uint64_t instruction, uint16_t keys) {
+    if (!events.empty() && events.back().instruction == instruction) {
+        events.pop_back();
+    }
+
+    uint16_t previous = events.empty() ? 0 : events.back().keys;
+    if (keys != previous) {
+        events.push_back({ instruction, keys });
+    }
+}
+
+void InputLog::truncate(uint64_t instruction) {
+    while (!events.empty() && events.back().instruction >= instruction) {
+        events.pop_back();
+    }
+    next = std::min(next, events.size());
+}
+
+void InputLog::run(Cpu &cpu, uint64_t count) {
+    uint64_t end = cpu.get_instructions() + count;
+    while (true) {
+        uint64_t now = cpu.get_instructions();
+        for (; next < events.size() && events[next].instruction <= now; next++) {
+            unpack(events[next].keys, cpu.get_keys());
+        }
+        if (now >= end)
+            return;
+
+        // stop at the next change so it lands on the instruction it was logged at
+        uint64_t stop = next < events.size() ? std::min(end, events[next].instruction) : end;
+        cpu.run(stop - now);
+        // stopped by the debugger
+        if (cpu.get_instructions() < stop)
+            return;
+    }
+}
+
+bool InputLog::write(const char *file) const {
+    std::vector<byte> body;
+    uint64_t last = 0;
+    for (const Event &event : events) {
+        uint64_t delta = event.instruction - last;
+        last = event.instruction;
+        do {
+            body.push_back(byte(delta & 0x7f) | (delta > 0x7f ? 0x80 : 0));
+            delta >>= 7;
+        } while (delta);
+        body.push_back(byte(event.keys));
+        body.push_back(byte(event.keys >> 8));
+    }
+
+    std::unique_ptr<FILE, int (*)(FILE *)> stream(fopen(file, "wb"), fclose);
+    if (!stream)
+        return false;
+
+    uint16_t version = file_version;
+    uint32_t count = events.size();
+    bool ok = fwrite(log_magic, sizeof(log_magic), 1, stream.get()) == 1
+        && fwrite(&version, sizeof(version), 1, stream.get()) == 1
+        && fwrite(&seed, sizeof(seed), 1, stream.get()) == 1
+        && fwrite(&timer_ratio, sizeof(timer_ratio), 1, stream.get()) == 1
+        && fwrite(&rom_hash, sizeof(rom_hash), 1, stream.get()) == 1
+        && fwrite(&length, sizeof(length), 1, stream.get()) == 1
+        && fwrite(&count, sizeof(count), 1, stream.get()) == 1
+        && fwrite(body.data(), 1, body.size(), stream.get()) == body.size();
+    return ok;
+}
+
+InputLog InputLog::read(const char *file) {
+    std::unique_ptr<FILE, int (*)(FILE *)> stream(fopen(file, "rb"), fclose);
+    if (!stream)
+        throw std::runtime_error("could not open input log");
+
+    InputLog log;
+    char magic[sizeof(log_magic)];
+    uint16_t version = 0;
+    uint32_t count = 0;
+    bool ok = fread(magic, sizeof(magic), 1, stream.get()) == 1
+        && fread(&version, sizeof(version), 1, stream.get()) == 1
+        && fread(&log.seed, sizeof(log.seed), 1, stream.get()) == 1
+        && fread(&log.timer_ratio, sizeof(log.timer_ratio), 1, stream.get()) == 1
+        && fread(&log.rom_hash, sizeof(log.rom_hash), 1, stream.get()) == 1
+        && fread(&log.length, sizeof(log.length), 1, stream.get()) == 1
+        && fread(&count, sizeof(count), 1, stream.get()) == 1;
+    if (!ok || std::memcmp(magic, log_magic, sizeof(magic)) != 0 || version != file_version) {
+        throw std::runtime_error("invalid input log");
+    }
+
+    uint64_t instruction = 0;
+    for (uint32_t n = 0; n < count; n++) {
+        uint64_t delta = 0;
+        int c = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            c = fgetc(stream.get());
+            if (c == EOF)
+                break;
+            delta |= uint64_t(c & 0x7f) << shift;
+            if (!(c & 0x80))
+                break;
+        }
+
+        int low = fgetc(stream.get());
+        int high = fgetc(stream.get());
+        if (c == EOF || low == EOF || high == EOF)
+            throw std::runtime_error("truncated input log");
+
+        instruction += delta;
+        log.events.push_back({ instruction, uint16_t(low | high << 8) });
+    }
+    return log;
+}
+
+bool InputLog::is_log(const char *file) {
+    std::unique_ptr<FILE, int (*)(FILE *)> stream(fopen(file, "rb"), fclose);
+    char magic[sizeof(log_magic)];
+    return stream && fread(magic, sizeof(magic), 1, stream.get()) == 1
+        && std::memcmp(magic, log_magic, sizeof(magic)) == 0;
+}
+
+InputLog InputLog::read_script(const char *file, uint32_t timer_ratio) {
+    std::ifstream stream(file);
+    if (!stream) {
+        throw std::runtime_error("could not open input script");
+    }
+
+    InputLog log;
+    log.timer_ratio = timer_ratio;
+    uint64_t frame;
+    uint16_t keys;
+    bool first = true;
+    uint64_t previous = 0;
+    while (stream >> std::dec >> frame >> std::hex >> keys) {
+        // add and replay take changes in order, one per instruction
+        if (!first && frame <= previous) {
+            throw std::runtime_error("input script frame " + std::to_string(frame) + " does not follow frame " +
+                                     std::to_string(previous));
+        }
+        log.add(frame * timer_ratio, keys);
+        first = false;
+        previous = frame;
+    }
+    return log;
+}
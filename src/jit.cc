@@ -0,0 +1,338 @@
+#include "jit.h"
+#include "cpu.h"
+#include "opcode.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#ifdef CHIP8_JIT
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#endif
+
+#ifdef CHIP8_JIT
+
+/// machine code emitter, operands: rdi = v, rsi = &i, rdx = &dt, rcx = &st,
+/// r10d = instruction limit
+class Emitter {
+public:
+    std::vector<byte> out;
+
+    void bytes(std::initializer_list<byte> data) {
+        out.insert(out.end(), data);
+    }
+
+    // mov al, [rdi + x]
+    void load(byte x) { bytes({ 0x8a, 0x47, x }); }
+    // mov [rdi + x], al
+    void store(byte x) { bytes({ 0x88, 0x47, x }); }
+    // mov [rdi + 15], r8b
+    void store_flag_r8() { bytes({ 0x44, 0x88, 0x47, 0x0f }); }
+
+    void prologue() {
+#ifdef _WIN32
+        // move win64 arguments (rcx, rdx, r8, r9, stack) to the sysv registers
+        bytes({ 0x57, 0x56 });                  // push rdi; push rsi
+        bytes({ 0x48, 0x89, 0xcf });            // mov rdi, rcx
+        bytes({ 0x48, 0x89, 0xd6 });            // mov rsi, rdx
+        bytes({ 0x4c, 0x89, 0xc2 });            // mov rdx, r8
+        bytes({ 0x4c, 0x89, 0xc9 });            // mov rcx, r9
+        bytes({ 0x44, 0x8b, 0x54, 0x24, 0x38 }); // mov r10d, [rsp + 56]
+#else
+        bytes({ 0x45, 0x89, 0xc2 });            // mov r10d, r8d
+#endif
+    }
+
+    /// leave before instruction k when the limit is reached
+    void check_limit(byte k) {
+        bytes({ 0x41, 0x83, 0xfa, k });         // cmp r10d, k
+        bytes({ 0x0f, 0x86, 0, 0, 0, 0 });      // jbe exit_k
+        exits.push_back({ out.size() - 4, k });
+    }
+
+    /// undo the last check_limit
+    void drop_limit() {
+        exits.pop_back();
+    }
+
+    /// return length, then the exit stubs of check_limit
+    void epilogue(byte length) {
+        ret_with(length);
+
+        for (auto &exit : exits) {
+            patch(exit.first, out.size());
+            ret_with(exit.second);
+        }
+    }
+
+    /// emit one instruction, false if it is not translated
+    bool emit(word opcode) {
+        byte x = (opcode & 0x0f00) >> 8;
+        byte y = (opcode & 0x00f0) >> 4;
+        byte kk = opcode & 0x00ff;
+        word nnn = opcode & 0x0fff;
+
+        switch (opcode >> 12) {
+            case 0x06:
+                bytes({ 0xc6, 0x47, x, kk });   // mov byte [rdi + x], kk
+                return true;
+            case 0x07:
+                bytes({ 0x80, 0x47, x, kk });   // add byte [rdi + x], kk
+                return true;
+            case 0x08:
+                return emit_alu(x, y, opcode & 0x000f);
+            case 0x0a:
+                // mov word [rsi], nnn
+                bytes({ 0x66, 0xc7, 0x06, byte(nnn & 0xff), byte(nnn >> 8) });
+                return true;
+            case 0x0f:
+                return emit_misc(x, kk);
+            default:
+                return false;
+        }
+    }
+
+private:
+    /// jump fixups: rel32 position, instructions run at that exit
+    std::vector<std::pair<size_t, byte>> exits;
+
+    /// mov eax, count; ret
+    void ret_with(byte count) {
+        bytes({ 0xb8, count, 0, 0, 0 });
+#ifdef _WIN32
+        bytes({ 0x5e, 0x5f });                  // pop rsi; pop rdi
+#endif
+        bytes({ 0xc3 });
+    }
+
+    /// point a rel32 at target
+    void patch(size_t at, size_t target) {
+        int32_t rel = int32_t(target - (at + 4));
+        std::memcpy(&out[at], &rel, sizeof(rel));
+    }
+
+    /// 8XYn, flag is written before vx like Operations does
+    bool emit_alu(byte x, byte y, byte n) {
+        switch (n) {
+            case 0x00: load(y); store(x); return true;
+            case 0x01: load(y); bytes({ 0x08, 0x47, x }); return true;     // or [rdi + x], al
+            case 0x02: load(y); bytes({ 0x20, 0x47, x }); return true;     // and [rdi + x], al
+            case 0x03: load(y); bytes({ 0x30, 0x47, x }); return true;     // xor [rdi + x], al
+            case 0x04:
+                load(x);
+                bytes({ 0x02, 0x47, y });                   // add al, [rdi + y]
+                bytes({ 0x41, 0x0f, 0x92, 0xc0 });          // setc r8b
+                store_flag_r8();
+                store(x);
+                return true;
+            case 0x05:
+                load(x);
+                bytes({ 0x3a, 0x47, y });                   // cmp al, [rdi + y]
+                bytes({ 0x41, 0x0f, 0x97, 0xc0 });          // seta r8b
+                store_flag_r8();
+                load(x);
+                bytes({ 0x2a, 0x47, y });                   // sub al, [rdi + y]
+                store(x);
+                return true;
+            case 0x06:
+                load(y);
+                bytes({ 0x24, 0x01 });                      // and al, 1
+                store(0x0f);
+                load(y);
+                bytes({ 0xd0, 0xe8 });                      // shr al, 1
+                store(x);
+                return true;
+            case 0x07:
+                load(y);
+                bytes({ 0x3a, 0x47, x });                   // cmp al, [rdi + x]
+                bytes({ 0x41, 0x0f, 0x97, 0xc0 });          // seta r8b
+                store_flag_r8();
+                load(y);
+                bytes({ 0x2a, 0x47, x });                   // sub al, [rdi + x]
+                store(x);
+                return true;
+            case 0x0e:
+                load(y);
+                bytes({ 0xc0, 0xe8, 0x07 });                // shr al, 7
+                store(0x0f);
+                load(y);
+                bytes({ 0x00, 0xc0 });                      // add al, al
+                store(x);
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    /// FXnn without memory access or waiting
+    bool emit_misc(byte x, byte kk) {
+        switch (kk) {
+            case 0x07:
+                bytes({ 0x8a, 0x02 });                      // mov al, [rdx]
+                store(x);
+                return true;
+            case 0x15:
+                load(x);
+                bytes({ 0x88, 0x02 });                      // mov [rdx], al
+                return true;
+            case 0x18:
+                load(x);
+                bytes({ 0x88, 0x01 });                      // mov [rcx], al
+                return true;
+            case 0x1e:
+                bytes({ 0x0f, 0xb6, 0x47, x });             // movzx eax, byte [rdi + x]
+                bytes({ 0x66, 0x01, 0x06 });                // add [rsi], ax
+                return true;
+            case 0x29:
+                bytes({ 0x0f, 0xb6, 0x47, x });             // movzx eax, byte [rdi + x]
+                bytes({ 0x8d, 0x04, 0x80 });                // lea eax, [rax + rax * 4]
+                bytes({ 0x66, 0x89, 0x06 });                // mov [rsi], ax
+                return true;
+            default:
+                return false;
+        }
+    }
+};
+
+Jit::Jit() : blocks(Cpu::mem_size / 2) {
+#ifdef _WIN32
+    code = static_cast<byte*>(VirtualAlloc(nullptr, code_size, MEM_COMMIT | MEM_RESERVE,
+        PAGE_READWRITE));
+#else
+    // never writable and executable at once, see protect
+    void *mem = mmap(nullptr, code_size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    code = (mem == MAP_FAILED) ? nullptr : static_cast<byte*>(mem);
+#endif
+    if (!code) {
+        throw std::runtime_error("allocate jit memory failed");
+    }
+
+    flush();
+}
+
+Jit::~Jit() {
+#ifdef _WIN32
+    VirtualFree(code, 0, MEM_RELEASE);
+#else
+    munmap(code, code_size);
+#endif
+}
+
+void Jit::translate(size_t addr, const byte *ram, Block &block) {
+    Emitter emitter;
+    emitter.prologue();
+
+    word length = 0;
+    for (size_t at = addr; length < max_block && at + 1 < Cpu::mem_size; at += 2) {
+        word opcode = word(ram[at] << 8 | ram[at + 1]);
+        size_t mark = emitter.out.size();
+
+        // idle loops are left to the interpreter which skips them
+        if (length > 0)
+            emitter.check_limit(length);
+        if (Operations::idle_handler(ram, at) || !emitter.emit(opcode)) {
+            emitter.out.resize(mark);
+            if (length > 0)
+                emitter.drop_limit();
+            break;
+        }
+        length++;
+    }
+    emitter.epilogue(length);
+
+    block.translated = true;
+    block.length = 0;
+    block.code = nullptr;
+    covered_begin = std::min(covered_begin, addr);
+    covered_end = std::max(covered_end, addr + 2 * std::max<size_t>(length, 1) + Cpu::max_decode_span);
+    if (length < min_block)
+        return;
+
+    if (code_used + emitter.out.size() > code_size) {
+        // start over, blocks are re-translated on demand
+        flush();
+        flushed = true;
+        block.translated = true;
+        covered_begin = addr;
+        covered_end = addr + 2 * length + Cpu::max_decode_span;
+    }
+
+    size_t end = code_used + emitter.out.size();
+    protect(code_used, end, true);
+    std::memcpy(code + code_used, emitter.out.data(), emitter.out.size());
+    protect(code_used, end, false);
+    block.code = reinterpret_cast<Code>(code + code_used);
+    block.length = length;
+    code_used += emitter.out.size();
+}
+
+void Jit::protect(size_t begin, size_t end, bool writable) {
+#ifdef _WIN32
+    size_t page = 4096;
+#else
+    static const size_t page = size_t(sysconf(_SC_PAGESIZE));
+#endif
+    begin &= ~(page - 1);
+    end = std::min((end + page - 1) & ~(page - 1), code_size);
+
+#ifdef _WIN32
+    DWORD old;
+    bool ok = VirtualProtect(code + begin, end - begin, writable ? PAGE_READWRITE : PAGE_EXECUTE_READ, &old);
+    if (ok && !writable)
+        FlushInstructionCache(GetCurrentProcess(), code + begin, end - begin);
+#else
+    bool ok = mprotect(code + begin, end - begin, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) == 0;
+#endif
+    if (!ok) {
+        throw std::runtime_error("protect jit memory failed");
+    }
+}
+
+#else
+
+Jit::Jit() {
+    throw std::runtime_error("jit is not supported on this host");
+}
+
+Jit::~Jit() {
+}
+
+void Jit::translate(size_t, const byte *, Block &block) {
+    block = {};
+    block.translated = true;
+}
+
+#endif
+
+size_t Jit::invalidate(size_t addr, size_t len) {
+    if (addr >= covered_end || addr + len <= covered_begin)
+        return addr;
+
+    size_t first = (std::max(addr, covered_begin + max_span - 1) - max_span + 1) >> 1;
+    size_t last = std::min((addr + len - 1) >> 1, blocks.size() - 1);
+    size_t lowest = addr;
+
+    for (size_t i = first; i <= last; i++) {
+        size_t start = i * 2;
+        // a block depends on its instructions and the idle loop check after them
+        size_t end = start + 2 * std::max<size_t>(blocks[i].length, 1) + Cpu::max_decode_span;
+        if (blocks[i].translated && end > addr) {
+            blocks[i] = {};
+            lowest = std::min(lowest, start);
+        }
+    }
+    return lowest;
+}
+
+void Jit::flush() {
+    std::fill(blocks.begin(), blocks.end(), Block{});
+    code_used = 0;
+    covered_begin = Cpu::mem_size;
+    covered_end = 0;
+}
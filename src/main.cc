@@ -1,29 +1,316 @@
-#include "cpu.h"
-#include "gui.h"
-#include <iostream>
-
-int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        std::cout << "Usage: chip8 ROM" << std::endl;
-        return 0;
-    }
-
-    Cpu cpu;
-    cpu.load_program(argv[1]);
-    cpu.set_debug(false);
-
-    Gui gui(Cpu::vram_width, Cpu::vram_height, 8);
-
-    while (true) {
-        if (gui.should_quit()) {
-            return 0;
-        }
-
-        cpu.cycle(gui.get_ticks());
-
-        gui.update_screen(cpu.get_vram());
-        gui.update_keys(cpu.get_keys());
-    }
-
-    return 0;
-}
+#include "cpu.h"
+#include "debugger.h"
+#include "gui.h"
+#include "input_log.h"
+#include "profile.h"
+#include "rewind.h"
+#include "trace_ring.h"
+#include "triple_buffer.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// memory kept for rewinding (backspace)
+static constexpr size_t rewind_budget = 16 << 20;
+/// instructions kept for --trace
+static constexpr size_t trace_size = 64 << 10;
+/// how often the window polls events and takes new frames
+static constexpr auto poll_time = std::chrono::milliseconds(2);
+
+static void usage() {
+    std::cout << "Usage: chip8 [--headless INSTRUCTIONS] [--timer-ratio N] [--seed N] [--jit] [--profile PREFIX] [--trace FILE]\n"
+                 "             [--record FILE | --replay FILE] [--break ADDR[:REG==N]]... [--watch ADDR[:LEN][:r|w|rw]]... ROM\n\n"
+                 "--record logs key changes of the session to FILE, --replay runs a logged\n"
+                 "session headless (for the logged length unless --headless is given).\n"
+                 "--break and --watch print the registers at every hit and run on; REG is\n"
+                 "V0-VF or I, compared with ==, !=, < or >."
+              << std::endl;
+}
+
+/// write PREFIX.txt (report) and PREFIX.folded (call stacks)
+static void write_profile(const Profiler &profiler, const std::string &prefix) {
+    FILE *report = fopen((prefix + ".txt").c_str(), "w");
+    FILE *folded = fopen((prefix + ".folded").c_str(), "w");
+    if (report)
+        profiler.write_report(report);
+    if (folded)
+        profiler.write_folded(folded);
+    if (!report || !folded)
+        std::cerr << "could not write profile " << prefix << std::endl;
+
+    if (report)
+        fclose(report);
+    if (folded)
+        fclose(folded);
+}
+
+/// write a recorded input log of a session that ran until now
+static void write_log(InputLog &log, const Cpu &cpu, const char *file) {
+    log.length = cpu.get_instructions();
+    if (!log.write(file))
+        std::cerr << "could not write input log " << file << std::endl;
+}
+
+/// print and resume a hit of the cpu's debugger, false if it is not stopped
+static bool report_hit(Cpu &cpu) {
+    Debugger *debugger = cpu.get_debugger();
+    if (!debugger || !debugger->stopped())
+        return false;
+
+    debugger->print_hit(stdout);
+    cpu.dump_registers();
+    debugger->resume();
+    return true;
+}
+
+/// run without display as fast as possible, then print final state,
+/// keys are set from replay if not null
+static void run_headless(Cpu &cpu, uint64_t count, InputLog *replay) {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t stop = cpu.get_instructions() + count;
+    do {
+        uint64_t left = stop - cpu.get_instructions();
+        if (replay)
+            replay->run(cpu, left);
+        else
+            cpu.run(left);
+    } while (report_hit(cpu));
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    std::cout << cpu.get_instructions() << " instructions in " << seconds * 1000.0 << " ms ("
+              << cpu.get_instructions() / seconds / 1e6 << " MIPS)\n\n";
+
+    const uint64_t *vram = cpu.get_vram();
+    char line[Cpu::vram_width + 1] = {};
+    for (size_t y = 0; y < Cpu::vram_height; y++) {
+        Cpu::expand_row(vram[y], line, '#', '.');
+        std::cout << line << '\n';
+    }
+    std::cout << std::endl;
+
+    cpu.dump_registers();
+}
+
+/// screen published by the emulation thread after every frame
+struct Screen {
+    uint64_t vram[Cpu::vram_height];
+};
+
+/// state shared by the emulation and the window thread
+struct Session {
+    TripleBuffer<Screen> screens;
+    /// pressed keys, bit n for key n, and rewind key, set by the window
+    std::atomic<uint16_t> keys{0};
+    std::atomic<bool> rewinding{false};
+    /// set by the window to end emulation
+    std::atomic<bool> quit{false};
+    /// set by the emulation thread when it ended, error holds why if it failed
+    std::atomic<bool> stopped{false};
+    std::exception_ptr error;
+};
+
+/// run frames at frame rate until quit, keys are logged to recorder if
+/// not null. Runs on its own thread, so a slow window does not stall it
+static void emulate(Cpu &cpu, InputLog *recorder, Session &session) {
+    Rewind rewind(rewind_budget);
+
+    using clock = std::chrono::steady_clock;
+    const auto frame_time = std::chrono::nanoseconds(1000000000 / Cpu::frame_rate);
+    auto next_frame = clock::now();
+
+    try {
+        while (!session.quit.load(std::memory_order_relaxed)) {
+            if (session.rewinding.load(std::memory_order_relaxed)) {
+                if (rewind.step_back(cpu) && recorder)
+                    recorder->truncate(cpu.get_instructions());
+            } else {
+                rewind.push(cpu);
+                InputLog::unpack(session.keys.load(std::memory_order_relaxed), cpu.get_keys());
+                if (recorder)
+                    recorder->record(cpu);
+                cpu.run_frame();
+                // the rest of the frame runs after a hit
+                while (report_hit(cpu))
+                    cpu.run_frame();
+            }
+
+            std::copy_n(cpu.get_vram(), Cpu::vram_height, session.screens.back().vram);
+            session.screens.publish();
+
+            // sleep until next frame, drop frames we are too late for
+            next_frame += frame_time;
+            auto now = clock::now();
+            if (next_frame < now) {
+                next_frame = now;
+            }
+            std::this_thread::sleep_until(next_frame);
+        }
+    } catch (...) {
+        session.error = std::current_exception();
+    }
+    session.stopped.store(true, std::memory_order_release);
+}
+
+/// run with display until the window is closed, keys are logged to
+/// recorder if not null. The window shows the newest published frame and
+/// passes keys back, rethrows errors of the emulation thread
+static void run_gui(Cpu &cpu, InputLog *recorder) {
+    Gui gui(Cpu::vram_width, Cpu::vram_height, 8);
+    Session session;
+    std::thread emulation(emulate, std::ref(cpu), recorder, std::ref(session));
+
+    // frames may be dropped between takes, so changed rows are found by
+    // comparing with the rows on screen
+    uint64_t shown[Cpu::vram_height] = {};
+
+    while (!session.stopped.load(std::memory_order_acquire) && !gui.should_quit()) {
+        session.keys.store(gui.get_keys(), std::memory_order_relaxed);
+        session.rewinding.store(gui.rewind_pressed(), std::memory_order_relaxed);
+
+        if (session.screens.take()) {
+            const uint64_t *vram = session.screens.front().vram;
+            uint32_t dirty_rows = 0;
+            for (size_t y = 0; y < Cpu::vram_height; y++) {
+                if (vram[y] != shown[y]) {
+                    dirty_rows |= uint32_t(1) << y;
+                    shown[y] = vram[y];
+                }
+            }
+            gui.update_screen(vram, dirty_rows);
+        }
+
+        std::this_thread::sleep_for(poll_time);
+    }
+
+    session.quit.store(true, std::memory_order_relaxed);
+    emulation.join();
+    if (session.error)
+        std::rethrow_exception(session.error);
+}
+
+int main(int argc, char *argv[]) {
+    const char *rom = nullptr;
+    bool headless = false;
+    uint64_t count = 0;
+    uint32_t timer_ratio = Cpu::default_timer_ratio;
+    uint64_t seed = 0;
+    bool jit = false;
+    const char *profile = nullptr;
+    const char *trace_file = nullptr;
+    const char *record_file = nullptr;
+    const char *replay_file = nullptr;
+    std::vector<const char*> breakpoints;
+    std::vector<const char*> watchpoints;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--headless") && i + 1 < argc) {
+            headless = true;
+            count = strtoull(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "--timer-ratio") && i + 1 < argc) {
+            timer_ratio = strtoul(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = strtoull(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "--jit")) {
+            jit = true;
+        } else if (!strcmp(argv[i], "--profile") && i + 1 < argc) {
+            profile = argv[++i];
+        } else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+            trace_file = argv[++i];
+        } else if (!strcmp(argv[i], "--record") && i + 1 < argc) {
+            record_file = argv[++i];
+        } else if (!strcmp(argv[i], "--replay") && i + 1 < argc) {
+            replay_file = argv[++i];
+        } else if (!strcmp(argv[i], "--break") && i + 1 < argc) {
+            breakpoints.push_back(argv[++i]);
+        } else if (!strcmp(argv[i], "--watch") && i + 1 < argc) {
+            watchpoints.push_back(argv[++i]);
+        } else {
+            rom = argv[i];
+        }
+    }
+
+    if (!rom || (record_file && replay_file)) {
+        usage();
+        return 0;
+    }
+
+    Cpu cpu;
+    cpu.set_seed(seed);
+    cpu.load_program(rom);
+    cpu.set_debug(false);
+    cpu.set_timer_ratio(timer_ratio);
+    cpu.set_jit(jit);
+
+    InputLog log;
+    try {
+        if (replay_file) {
+            log = InputLog::read(replay_file);
+            log.apply(cpu);
+            if (!headless) {
+                headless = true;
+                count = log.length;
+            }
+        } else if (record_file) {
+            log.begin(cpu);
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    Profiler profiler;
+    if (profile)
+        cpu.set_profiler(&profiler);
+
+    TraceRing trace(trace_size);
+    if (trace_file)
+        cpu.set_trace(&trace);
+
+    Debugger debugger;
+    try {
+        for (const char *spec : breakpoints)
+            debugger.add_breakpoint(spec);
+        for (const char *spec : watchpoints)
+            debugger.add_watchpoint(spec);
+    } catch (const std::exception &e) {
+        std::cerr << "error: " << e.what() << std::endl;
+        return 1;
+    }
+    if (!breakpoints.empty() || !watchpoints.empty())
+        cpu.set_debugger(&debugger);
+
+    try {
+        if (headless)
+            run_headless(cpu, count, replay_file ? &log : nullptr);
+        else
+            run_gui(cpu, record_file ? &log : nullptr);
+    } catch (const std::exception &e) {
+        std::cerr << "error: " << e.what() << std::endl;
+        if (trace_file) {
+            if (trace.write(trace_file))
+                std::cerr << "last " << std::min<uint64_t>(trace.pushed(), trace.capacity())
+                          << " instructions written to " << trace_file << std::endl;
+            else
+                std::cerr << "could not write trace " << trace_file << std::endl;
+        }
+        if (record_file)
+            write_log(log, cpu, record_file);
+        return 1;
+    }
+
+    if (record_file)
+        write_log(log, cpu, record_file);
+
+    if (profile)
+        write_profile(profiler, profile);
+    return 0;
+}
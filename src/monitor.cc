@@ -0,0 +1,168 @@
+#include "cpu.h"
+#include "input_log.h"
+#include "term.h"
+#include "triple_buffer.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <thread>
+
+/// screen published by the emulation thread after every frame
+struct Screen {
+    uint64_t vram[Cpu::vram_height];
+};
+
+/// state shared by the emulation and the output thread
+struct Session {
+    TripleBuffer<Screen> screens;
+    /// set on interrupt or by the output thread to end emulation
+    std::atomic<bool> quit{false};
+    /// set by the emulation thread when it ended, error holds why if it failed
+    std::atomic<bool> stopped{false};
+    std::exception_ptr error;
+};
+
+/// interrupted by ctrl-c, the terminal is restored before exiting
+static std::atomic<bool> interrupted{false};
+
+static void on_interrupt(int) {
+    interrupted.store(true, std::memory_order_relaxed);
+}
+
+static void usage() {
+    std::cout << "Usage: chip8_term [--timer-ratio N] [--seed N] [--fps N] [--frames N] [--replay FILE] ROM\n\n"
+                 "Runs ROM at 60 frames per second and draws its screen on this terminal\n"
+                 "with half blocks, sending only the cells that changed. --fps limits how\n"
+                 "often the terminal is updated (default 30), --frames stops after N frames,\n"
+                 "--replay takes keys from an input log."
+              << std::endl;
+}
+
+/// run frames at frame rate until quit or frames ran out (0 for no limit),
+/// keys are set from replay if not null
+static void emulate(Cpu &cpu, InputLog *replay, uint64_t frames, Session &session) {
+    using clock = std::chrono::steady_clock;
+    const auto frame_time = std::chrono::nanoseconds(1000000000 / Cpu::frame_rate);
+    auto next_frame = clock::now();
+
+    try {
+        for (uint64_t frame = 0; !frames || frame < frames; frame++) {
+            if (session.quit.load(std::memory_order_relaxed))
+                break;
+            if (replay)
+                replay->run(cpu, cpu.get_timer_ratio());
+            else
+                cpu.run_frame();
+
+            std::copy_n(cpu.get_vram(), Cpu::vram_height, session.screens.back().vram);
+            session.screens.publish();
+
+            // sleep until next frame, drop frames we are too late for
+            next_frame += frame_time;
+            auto now = clock::now();
+            if (next_frame < now) {
+                next_frame = now;
+            }
+            std::this_thread::sleep_until(next_frame);
+        }
+    } catch (...) {
+        session.error = std::current_exception();
+    }
+    session.stopped.store(true, std::memory_order_release);
+}
+
+int main(int argc, char *argv[]) {
+    const char *rom = nullptr;
+    uint32_t timer_ratio = Cpu::default_timer_ratio;
+    uint64_t seed = 0;
+    uint32_t fps = 30;
+    uint64_t frames = 0;
+    const char *replay_file = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--timer-ratio") && i + 1 < argc) {
+            timer_ratio = strtoul(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = strtoull(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "--fps") && i + 1 < argc) {
+            fps = strtoul(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frames = strtoull(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "--replay") && i + 1 < argc) {
+            replay_file = argv[++i];
+        } else if (argv[i][0] != '-' && !rom) {
+            rom = argv[i];
+        } else {
+            usage();
+            return 0;
+        }
+    }
+
+    if (!rom || fps == 0 || timer_ratio == 0) {
+        usage();
+        return 0;
+    }
+
+    Cpu cpu;
+    InputLog log;
+    try {
+        cpu.set_seed(seed);
+        cpu.load_program(rom);
+        cpu.set_timer_ratio(timer_ratio);
+        if (replay_file) {
+            log = InputLog::read(replay_file);
+            log.apply(cpu);
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::signal(SIGINT, on_interrupt);
+    std::signal(SIGTERM, on_interrupt);
+
+    Session session;
+    std::thread emulation(emulate, std::ref(cpu), replay_file ? &log : nullptr, frames, std::ref(session));
+
+    // writes may block on a slow link, frames published meanwhile are dropped
+    TermScreen screen;
+    const auto update_time = std::chrono::nanoseconds(1000000000 / fps);
+    bool done = false;
+    while (!done) {
+        done = session.stopped.load(std::memory_order_acquire);
+        if (interrupted.load(std::memory_order_relaxed)) {
+            session.quit.store(true, std::memory_order_relaxed);
+            done = true;
+        }
+
+        if (session.screens.take()) {
+            std::string out = screen.update(session.screens.front().vram);
+            fwrite(out.data(), 1, out.size(), stdout);
+            fflush(stdout);
+        }
+        if (!done)
+            std::this_thread::sleep_for(update_time);
+    }
+
+    emulation.join();
+    std::string out = TermScreen::finish();
+    fwrite(out.data(), 1, out.size(), stdout);
+    fflush(stdout);
+
+    if (session.error) {
+        try {
+            std::rethrow_exception(session.error);
+        } catch (const std::exception &e) {
+            std::cerr << "error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
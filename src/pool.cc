@@ -0,0 +1,96 @@
+#include "pool.h"
+
+ThreadPool::ThreadPool(size_t threads) {
+    if (threads == 0)
+        threads = 1;
+
+    for (size_t i = 0; i < threads; i++) {
+        queues.emplace_back(new Queue);
+    }
+    for (size_t i = 0; i < threads; i++) {
+        workers.emplace_back(&ThreadPool::work, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(state_lock);
+        stopping = true;
+    }
+    work_ready.notify_all();
+
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(Task task) {
+    Queue &queue = *queues[next++ % queues.size()];
+    pending++;
+    // counted before it is queued so a pop never takes queued below zero,
+    // workers seeing it early retry until the task is there
+    queued++;
+    {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.tasks.push_back(std::move(task));
+    }
+
+    // a worker going to sleep counts itself in sleeping before it checks
+    // queued, so either it sees the task or we see it and wake it
+    if (sleeping > 0) {
+        std::lock_guard<std::mutex> guard(state_lock);
+        work_ready.notify_one();
+    }
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> guard(state_lock);
+    all_done.wait(guard, [this] { return pending == 0; });
+}
+
+bool ThreadPool::pop(size_t self, Task &task) {
+    {
+        Queue &own = *queues[self];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            queued--;
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < queues.size(); i++) {
+        Queue &victim = *queues[(self + i) % queues.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queued--;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::work(size_t self) {
+    while (true) {
+        Task task;
+        if (pop(self, task)) {
+            task();
+            if (--pending == 0) {
+                std::lock_guard<std::mutex> guard(state_lock);
+                all_done.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> guard(state_lock);
+        sleeping++;
+        work_ready.wait(guard, [this] { return stopping || queued > 0; });
+        sleeping--;
+        if (stopping && queued == 0)
+            return;
+    }
+}
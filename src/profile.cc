@@ -0,0 +1,115 @@
+#include "profile.h"
+#include "cpu.h"
+#include <algorithm>
+
+static const char *const CLASS_NAMES[Profiler::op_class_count] = {
+    "0NNN SYS", "00E0 CLS", "00EE RET", "1NNN JP", "2NNN CALL", "3XKK SE", "4XKK SNE", "5XY0 SE",
+    "6XKK LD", "7XKK ADD", "8XY0 LD", "8XY1 OR", "8XY2 AND", "8XY3 XOR", "8XY4 ADD", "8XY5 SUB",
+    "8XY6 SHR", "8XY7 SUBN", "8XYE SHL", "9XY0 SNE", "ANNN LD I", "BNNN JP V0", "CXKK RND", "DXYN DRW",
+    "EX9E SKP", "EXA1 SKNP", "FX07 LD DT", "FX0A LD KEY", "FX15 LD DT", "FX18 LD ST", "FX1E ADD I", "FX29 LD F",
+    "FX33 BCD", "FX55 LD [I]", "FX65 LD [I]", "invalid",
+};
+
+Profiler::Profiler() : addresses(Cpu::mem_size) {
+    clear();
+}
+
+const char *Profiler::class_name(OpClass op) {
+    return CLASS_NAMES[op];
+}
+
+void Profiler::clear() {
+    std::fill_n(classes, op_class_count, 0);
+    std::fill(addresses.begin(), addresses.end(), 0);
+
+    nodes.assign(1, Node{ 0, 0, 0 });
+    children.clear();
+    current = 0;
+
+    draws = 0;
+    drawn_pixels = 0;
+    collided_pixels = 0;
+    collided_draws = 0;
+}
+
+uint64_t Profiler::total() const {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < op_class_count; i++) {
+        sum += classes[i];
+    }
+    return sum;
+}
+
+void Profiler::enter(word function) {
+    auto key = std::make_pair(current, function);
+    auto found = children.find(key);
+    if (found != children.end()) {
+        current = found->second;
+        return;
+    }
+
+    nodes.push_back(Node{ current, function, 0 });
+    current = nodes.size() - 1;
+    children.emplace(key, current);
+}
+
+std::string Profiler::stack_name(size_t node) const {
+    std::vector<word> functions;
+    for (; node != 0; node = nodes[node].parent) {
+        functions.push_back(nodes[node].function);
+    }
+
+    std::string name = "main";
+    char frame[16];
+    for (auto it = functions.rbegin(); it != functions.rend(); ++it) {
+        snprintf(frame, sizeof(frame), ";sub_0x%03X", *it);
+        name += frame;
+    }
+    return name;
+}
+
+void Profiler::write_report(FILE *out, size_t top_addresses) const {
+    uint64_t sum = total();
+    double scale = sum ? 100.0 / sum : 0.0;
+    fprintf(out, "%llu instructions\n\n", (unsigned long long) sum);
+
+    std::vector<size_t> order;
+    for (size_t i = 0; i < op_class_count; i++) {
+        if (classes[i])
+            order.push_back(i);
+    }
+    std::stable_sort(order.begin(), order.end(),
+        [&](size_t a, size_t b) { return classes[a] > classes[b]; });
+
+    fprintf(out, "%-12s %14s %7s\n", "opcode", "count", "%");
+    for (size_t i : order) {
+        fprintf(out, "%-12s %14llu %6.2f%%\n", CLASS_NAMES[i],
+            (unsigned long long) classes[i], classes[i] * scale);
+    }
+
+    order.clear();
+    for (size_t i = 0; i < addresses.size(); i++) {
+        if (addresses[i])
+            order.push_back(i);
+    }
+    std::stable_sort(order.begin(), order.end(),
+        [&](size_t a, size_t b) { return addresses[a] > addresses[b]; });
+    order.resize(std::min(order.size(), top_addresses));
+
+    fprintf(out, "\n%-7s %14s %7s\n", "address", "count", "%");
+    for (size_t addr : order) {
+        fprintf(out, "0x%03zX   %14llu %6.2f%%\n", addr,
+            (unsigned long long) addresses[addr], addresses[addr] * scale);
+    }
+
+    fprintf(out, "\n%llu draws, %llu pixels drawn, %llu pixels erased in %llu colliding draws\n",
+        (unsigned long long) draws, (unsigned long long) drawn_pixels,
+        (unsigned long long) collided_pixels, (unsigned long long) collided_draws);
+}
+
+void Profiler::write_folded(FILE *out) const {
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i].count)
+            fprintf(out, "%s %llu\n", stack_name(i).c_str(), (unsigned long long) nodes[i].count);
+    }
+}
@@ -0,0 +1,234 @@
+#include "cpu.h"
+#include "disasm.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <set>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+/// load address of ROMs
+static constexpr size_t origin = 0x200;
+
+static void usage() {
+    std::cout << "Usage: chip8_aot ROM [OUTPUT]\n\n"
+                 "Writes a C++ source of the ROM's reachable code, one function per basic\n"
+                 "block. Link it into chip8 or chip8_batch (CHIP8_AOT_SOURCES in cmake) and\n"
+                 "the ROM runs compiled, code not found here or modified at run time is\n"
+                 "interpreted."
+              << std::endl;
+}
+
+/// text as the contents of a C++ string literal, quotes, backslashes and
+/// control characters escaped so a file name can not end the literal
+static std::string escape(const std::string &text) {
+    std::string out;
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += char(c);
+        } else if (c < 0x20 || c >= 0x7f) {
+            // three octal digits, a following digit can not extend them
+            char octal[8];
+            snprintf(octal, sizeof(octal), "\\%03o", c);
+            out += octal;
+        } else {
+            out += char(c);
+        }
+    }
+    return out;
+}
+
+/// how control leaves an instruction
+enum class Flow {
+    /// falls through to the next instruction
+    next,
+    /// ends its block
+    end,
+    /// not a valid opcode
+    invalid,
+};
+
+/// flow of opcode at addr, static successors that start blocks go to targets
+static Flow classify(word opcode, size_t addr, std::vector<size_t> &targets) {
+    if (disassemble(opcode).empty())
+        return Flow::invalid;
+
+    word nnn = opcode & 0x0fff;
+    switch (opcode >> 12) {
+        case 0x00:
+            return opcode == 0x00ee ? Flow::end : Flow::next;
+        case 0x01:
+            targets.push_back(nnn);
+            return Flow::end;
+        case 0x02:
+            targets.push_back(nnn);
+            targets.push_back(addr + 2);
+            return Flow::end;
+        case 0x03: case 0x04: case 0x05: case 0x09: case 0x0e:
+            targets.push_back(addr + 2);
+            targets.push_back(addr + 4);
+            return Flow::end;
+        case 0x0b:
+            // target depends on V0, reached through the interpreter
+            return Flow::end;
+        case 0x0f:
+            // wait for key repeats itself, stores may overwrite the code after them
+            if ((opcode & 0xff) == 0x0a || (opcode & 0xff) == 0x33 || (opcode & 0xff) == 0x55) {
+                targets.push_back(addr + 2);
+                return Flow::end;
+            }
+            return Flow::next;
+        default:
+            return Flow::next;
+    }
+}
+
+class Recompiler {
+public:
+    explicit Recompiler(std::vector<byte> image) : image(std::move(image)) {}
+
+    /// find blocks reachable from the program start
+    void discover() {
+        std::vector<size_t> work = { origin };
+        std::vector<bool> seen(Cpu::mem_size);
+
+        while (!work.empty()) {
+            size_t addr = work.back();
+            work.pop_back();
+            if (!contains(addr) || !leaders.insert(addr).second)
+                continue;
+
+            // follow the fall through path until the block ends
+            for (size_t at = addr; contains(at) && !seen[at]; at += 2) {
+                seen[at] = true;
+                if (classify(opcode(at), at, work) != Flow::next)
+                    break;
+            }
+        }
+    }
+
+    /// write the C++ source
+    void write(FILE *out, const std::string &name) const {
+        std::string quoted = escape(name);
+        fprintf(out, "// generated by chip8_aot from %s, do not edit\n\n", quoted.c_str());
+        fprintf(out, "#include \"aot.h\"\n#include \"opcode.h\"\n\nnamespace {\n\n");
+        fprintf(out, "using Op = Operations;\n\n");
+
+        fprintf(out, "const byte image[] = {");
+        for (size_t i = 0; i < image.size(); i++) {
+            fprintf(out, "%s0x%02x,", (i % 16) ? " " : "\n    ", image[i]);
+        }
+        fprintf(out, "\n};\n\n");
+
+        // entry address, bytes to block end, block start
+        std::vector<std::tuple<size_t, size_t, size_t>> entries;
+        size_t max_size = 0;
+        for (size_t addr : leaders) {
+            size_t size = block_size(addr);
+            if (size == 0)
+                continue;
+
+            // slices end anywhere, so a block can be entered at any instruction
+            fprintf(out, "void block_%04zx(Cpu &cpu, const Instruction &ins) {\n", addr);
+            fprintf(out, "    switch (ins.nnn) {\n");
+            for (size_t at = addr; at < addr + size; at += 2) {
+                if (at != addr) {
+                    fprintf(out, "            if (!Op::advance(cpu))\n                return;\n");
+                    fprintf(out, "            // fall through\n");
+                }
+                fprintf(out, "        case 0x%03zx:\n", at);
+                fprintf(out, "            Op::exec<0x%04X>(cpu);  // %s\n",
+                    opcode(at), disassemble(opcode(at)).c_str());
+                entries.emplace_back(at, addr + size - at, addr);
+            }
+            fprintf(out, "    }\n}\n\n");
+            max_size = std::max(max_size, size);
+        }
+
+        fprintf(out, "const AotProgram::Block blocks[] = {\n");
+        for (auto &entry : entries) {
+            fprintf(out, "    { 0x%03zx, %zu, block_%04zx },\n",
+                std::get<0>(entry), std::get<1>(entry), std::get<2>(entry));
+        }
+        fprintf(out, "};\n\n");
+
+        fprintf(out, "const AotProgram program = {\n");
+        fprintf(out, "    \"%s\", 0x%03zx, image, sizeof(image),\n", quoted.c_str(), origin);
+        fprintf(out, "    blocks, sizeof(blocks) / sizeof(*blocks), %zu,\n", max_size);
+        fprintf(out, "};\n\n");
+        fprintf(out, "const bool registered = AotProgram::add(program);\n\n}\n");
+    }
+
+    size_t block_count() const { return leaders.size(); }
+
+private:
+    std::vector<byte> image;
+    /// block start addresses
+    std::set<size_t> leaders;
+
+    bool contains(size_t addr) const {
+        return !(addr & 1) && addr >= origin && addr + 1 < origin + image.size();
+    }
+
+    word opcode(size_t addr) const {
+        return word(image[addr - origin] << 8 | image[addr - origin + 1]);
+    }
+
+    /// bytes from a block start to its end, a block stops after its last
+    /// instruction, before an invalid opcode or before another block
+    size_t block_size(size_t addr) const {
+        std::vector<size_t> targets;
+        size_t at = addr;
+        while (contains(at)) {
+            Flow flow = classify(opcode(at), at, targets);
+            if (flow == Flow::invalid)
+                break;
+            at += 2;
+            if (flow == Flow::end || leaders.count(at))
+                break;
+        }
+        return at - addr;
+    }
+};
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || argc > 3) {
+        usage();
+        return 0;
+    }
+
+    std::ifstream stream(argv[1], std::ios::binary);
+    if (!stream) {
+        std::cerr << "could not open file" << std::endl;
+        return 1;
+    }
+    std::vector<byte> image((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    if (image.empty() || image.size() > Cpu::mem_size - origin) {
+        std::cerr << "invalid rom size" << std::endl;
+        return 1;
+    }
+
+    FILE *out = (argc == 3) ? fopen(argv[2], "w") : stdout;
+    if (!out) {
+        std::cerr << "could not open output" << std::endl;
+        return 1;
+    }
+
+    std::string name = argv[1];
+    name = name.substr(name.find_last_of("/\\") + 1);
+
+    Recompiler recompiler(std::move(image));
+    recompiler.discover();
+    recompiler.write(out, name);
+
+    if (out != stdout)
+        fclose(out);
+    std::cerr << recompiler.block_count() << " blocks" << std::endl;
+    return 0;
+}
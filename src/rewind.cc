@@ -0,0 +1,123 @@
+#include "rewind.h"
+#include <algorithm>
+
+// delta encoding: repeated (zero run, literal length, literal bytes) with
+// both lengths as LEB128 varints, literals are the xor of the two states
+
+static void put_varint(std::vector<byte> &out, size_t value) {
+    while (value >= 0x80) {
+        out.push_back(byte(value) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(byte(value));
+}
+
+static size_t get_varint(const byte *&in) {
+    size_t value = 0;
+    for (int shift = 0; ; shift += 7) {
+        byte b = *in++;
+        value |= size_t(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return value;
+    }
+}
+
+Rewind::Rewind(size_t memory_budget, uint32_t keyframe_interval)
+    : memory_budget(memory_budget), keyframe_interval(std::max<uint32_t>(keyframe_interval, 1)),
+      state(Cpu::state_size)
+{
+}
+
+void Rewind::push(const Cpu &cpu) {
+    cpu.save_state(state.data());
+
+    if (segments.empty() || segments.back().offsets.size() + 1 >= keyframe_interval) {
+        segments.emplace_back();
+        segments.back().keyframe = state;
+    } else {
+        Segment &segment = segments.back();
+        used -= segment_size(segment);
+        segment.offsets.push_back(segment.deltas.size());
+        encode(segment.keyframe.data(), state.data(), state.size(), segment.deltas);
+    }
+    used += segment_size(segments.back());
+    count++;
+
+    // drop oldest segments, but always keep the one being filled
+    while (used > memory_budget && segments.size() > 1) {
+        used -= segment_size(segments.front());
+        count -= segments.front().offsets.size() + 1;
+        segments.pop_front();
+    }
+}
+
+bool Rewind::step_back(Cpu &cpu) {
+    if (segments.empty())
+        return false;
+
+    Segment &segment = segments.back();
+    used -= segment_size(segment);
+    count--;
+
+    if (segment.offsets.empty()) {
+        cpu.load_state(segment.keyframe);
+        segments.pop_back();
+        return true;
+    }
+
+    uint32_t offset = segment.offsets.back();
+    std::copy(segment.keyframe.begin(), segment.keyframe.end(), state.begin());
+    apply(segment.deltas.data() + offset, segment.deltas.data() + segment.deltas.size(), state.data());
+
+    segment.deltas.resize(offset);
+    segment.offsets.pop_back();
+    used += segment_size(segment);
+
+    cpu.load_state(state);
+    return true;
+}
+
+void Rewind::clear() {
+    segments.clear();
+    count = 0;
+    used = 0;
+}
+
+size_t Rewind::segment_size(const Segment &segment) {
+    return segment.keyframe.size() + segment.deltas.size()
+         + segment.offsets.size() * sizeof(uint32_t);
+}
+
+void Rewind::encode(const byte *a, const byte *b, size_t size, std::vector<byte> &out) {
+    size_t pos = 0;
+    while (pos < size) {
+        size_t zeros = pos;
+        while (zeros < size && a[zeros] == b[zeros])
+            zeros++;
+        if (zeros == size)
+            break;
+
+        // literal run ends at the next two equal bytes, single equal
+        // bytes cost less inline than a new run header
+        size_t end = zeros;
+        while (end < size && !(a[end] == b[end] && (end + 1 == size || a[end + 1] == b[end + 1])))
+            end++;
+
+        put_varint(out, zeros - pos);
+        put_varint(out, end - zeros);
+        for (size_t i = zeros; i < end; i++) {
+            out.push_back(a[i] ^ b[i]);
+        }
+        pos = end;
+    }
+}
+
+void Rewind::apply(const byte *delta, const byte *end, byte *state) {
+    while (delta < end) {
+        state += get_varint(delta);
+        size_t literal = get_varint(delta);
+        for (size_t i = 0; i < literal; i++) {
+            *state++ ^= *delta++;
+        }
+    }
+}
@@ -0,0 +1,70 @@
+#include "rom_image.h"
+#include "opcode.h"
+#include "state_hash.h"
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+/// font sprite data ('0' - 'F')
+static uint8_t HEX_FONTS[] = {
+    0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+    0x20, 0x60, 0x20, 0x20, 0x70, // 1
+    0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+    0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+    0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+    0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+    0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+    0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+    0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+    0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+    0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+    0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+    0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+    0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+    0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+    0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+};
+
+std::shared_ptr<const RomImage> RomImage::load(const char *file) {
+    std::ifstream stream(file, std::ios::binary);
+
+    if (!stream) {
+        throw std::runtime_error("could not open file");
+    }
+
+    byte program[max_program_size];
+    stream.read(reinterpret_cast<char*>(program), max_program_size);
+    return create(program, stream.gcount());
+}
+
+std::shared_ptr<const RomImage> RomImage::create(const byte *program, size_t size) {
+    if (size > max_program_size) {
+        throw std::runtime_error("program too large");
+    }
+
+    auto image = std::make_shared<RomImage>();
+    std::fill_n(image->ram, Cpu::mem_size, 0);
+    std::copy_n(HEX_FONTS, sizeof(HEX_FONTS), image->ram);
+    std::copy_n(program, size, image->ram + program_start);
+    image->aot = AotProgram::find(image->ram + program_start, size);
+    for (size_t page = 0; page < Cpu::page_count; page++) {
+        image->page_hashes[page] = StateHash::bytes(image->ram + page * Cpu::page_size, Cpu::page_size, page);
+    }
+
+    // data decodes too, as long as it is valid instructions
+    for (size_t addr = 0; addr < Cpu::mem_size; addr += 2) {
+        Instruction &entry = image->decoded[addr >> 1];
+        try {
+            entry = Operations::decode_at<NoTrace>(image->ram, addr, image->aot, nullptr);
+        } catch (const std::exception &) {
+            entry = {};
+            entry.exec = Operations::decode_entry<NoTrace>;
+        }
+    }
+    return image;
+}
+
+std::shared_ptr<const RomImage> RomImage::blank() {
+    static const std::shared_ptr<const RomImage> image = create(nullptr, 0);
+    return image;
+}
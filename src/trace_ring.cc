@@ -0,0 +1,88 @@
+#include "trace_ring.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+
+/// trace file magic
+static constexpr char trace_magic[4] = { 'C', '8', 'T', 'R' };
+
+// file layout, host byte order: magic, version (u16), record size (u16),
+// record count (u32), records oldest first
+static_assert(sizeof(TraceRing::Record) == 22, "records are written as is");
+
+TraceRing::TraceRing(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    slots = std::vector<Slot>(size);
+    mask = size - 1;
+}
+
+std::vector<TraceRing::Record> TraceRing::snapshot(size_t count) const {
+    uint64_t end = head.load(std::memory_order_acquire);
+    uint64_t begin = end - std::min<uint64_t>({ end, count, slots.size() });
+
+    std::vector<Record> out(end - begin);
+    for (uint64_t n = begin; n < end; n++) {
+        const Slot &slot = slots[n & mask];
+        uint64_t words[slot_words];
+        for (size_t k = 0; k < slot_words; k++) {
+            words[k] = slot.words[k].load(std::memory_order_relaxed);
+        }
+        std::memcpy(&out[n - begin], words, sizeof(Record));
+    }
+
+    // push number now may be writing the slot of record now - size, drop
+    // that record and every older one
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t now = head.load(std::memory_order_relaxed);
+    if (now - begin >= slots.size()) {
+        size_t lost = std::min<uint64_t>(now - begin - slots.size() + 1, out.size());
+        out.erase(out.begin(), out.begin() + lost);
+    }
+    return out;
+}
+
+bool TraceRing::write(const char *file, size_t count) const {
+    std::vector<Record> out = snapshot(count);
+
+    std::unique_ptr<FILE, int (*)(FILE *)> stream(fopen(file, "wb"), fclose);
+    if (!stream)
+        return false;
+
+    uint16_t version = file_version;
+    uint16_t record_size = sizeof(Record);
+    uint32_t records = out.size();
+    bool ok = fwrite(trace_magic, sizeof(trace_magic), 1, stream.get()) == 1
+        && fwrite(&version, sizeof(version), 1, stream.get()) == 1
+        && fwrite(&record_size, sizeof(record_size), 1, stream.get()) == 1
+        && fwrite(&records, sizeof(records), 1, stream.get()) == 1
+        && fwrite(out.data(), sizeof(Record), out.size(), stream.get()) == out.size();
+    return ok;
+}
+
+std::vector<TraceRing::Record> TraceRing::read(const char *file) {
+    std::unique_ptr<FILE, int (*)(FILE *)> stream(fopen(file, "rb"), fclose);
+    if (!stream)
+        throw std::runtime_error("could not open file");
+
+    char magic[sizeof(trace_magic)];
+    uint16_t version = 0, record_size = 0;
+    uint32_t records = 0;
+    bool ok = fread(magic, sizeof(magic), 1, stream.get()) == 1
+        && fread(&version, sizeof(version), 1, stream.get()) == 1
+        && fread(&record_size, sizeof(record_size), 1, stream.get()) == 1
+        && fread(&records, sizeof(records), 1, stream.get()) == 1;
+    if (!ok || std::memcmp(magic, trace_magic, sizeof(magic)) != 0
+        || version != file_version || record_size != sizeof(Record)) {
+        throw std::runtime_error("invalid trace file");
+    }
+
+    std::vector<Record> out(records);
+    if (fread(out.data(), sizeof(Record), records, stream.get()) != records)
+        throw std::runtime_error("truncated trace file");
+    return out;
+}
@@ -0,0 +1,60 @@
+#include "disasm.h"
+#include "trace_ring.h"
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+static void usage() {
+    std::cout << "Usage: chip8_trace TRACE_FILE [COUNT]\n\n"
+                 "Disassembles the last COUNT (default all) records of a trace written by\n"
+                 "chip8 --trace, oldest first, with the registers each instruction changed."
+              << std::endl;
+}
+
+/// registers changed between two records
+static std::string changes(const TraceRing::Record &before, const TraceRing::Record &after) {
+    std::string text;
+    char part[16];
+    if (before.i != after.i) {
+        snprintf(part, sizeof(part), " I=%04X", after.i);
+        text += part;
+    }
+    for (size_t x = 0; x < sizeof(before.v); x++) {
+        if (before.v[x] != after.v[x]) {
+            snprintf(part, sizeof(part), " V%X=%02X", unsigned(x), after.v[x]);
+            text += part;
+        }
+    }
+    return text;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || argc > 3) {
+        usage();
+        return 0;
+    }
+
+    try {
+        std::vector<TraceRing::Record> records = TraceRing::read(argv[1]);
+        size_t count = (argc == 3) ? strtoul(argv[2], nullptr, 0) : records.size();
+        size_t first = records.size() - std::min(count, records.size());
+
+        for (size_t n = first; n < records.size(); n++) {
+            const TraceRing::Record &record = records[n];
+            std::string text = disassemble(record.opcode);
+            if (text.empty())
+                text = "???";
+
+            // the newest record did not complete, usually the one that failed
+            std::string changed = (n + 1 < records.size()) ? changes(record, records[n + 1])
+                                                           : " (last)";
+            printf("%04X  %04X  %-18s%s\n", record.pc, record.opcode, text.c_str(), changed.c_str());
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,329 @@
+#include "cpu.h"
+#include "debugger.h"
+#include "input_log.h"
+#include "jit.h"
+#include "lockstep.h"
+#include "random.h"
+#include "rom_gen.h"
+#include "rom_image.h"
+#include "trace_ring.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/// runs of every ROM, one per lane of the lockstep check
+static constexpr size_t variants = 8;
+/// instructions run of generated ROMs
+static constexpr uint64_t generated_length = 4000;
+
+/// ways to run a Cpu, all must end in the state of the reference
+enum Mode {
+    /// RingTrace, dispatches every instruction on its own
+    reference,
+    /// NoTrace without compiled program
+    plain,
+    jit,
+    /// registered compiled program, if the ROM has one
+    aot,
+    /// WatchTrace of a debugger without breakpoints
+    debugger,
+    mode_count,
+};
+
+static const char *const mode_names[mode_count] = { "reference", "plain", "jit", "aot", "debugger" };
+
+/// keys held during count instructions
+struct Slice {
+    uint32_t count;
+    uint16_t keys;
+};
+
+/// inputs of one run; runs of a ROM share slice counts, so they fit the
+/// lanes of a Lockstep
+struct Schedule {
+    uint64_t seed;
+    uint32_t timer_ratio;
+    std::vector<Slice> slices;
+};
+
+/// state a run ended in
+struct Outcome {
+    uint64_t hash;
+    uint64_t instructions;
+    std::string error;
+    Cpu::Register reg;
+    byte ram[Cpu::mem_size];
+    uint64_t vram[Cpu::vram_height];
+};
+
+static size_t failures = 0;
+
+static void fail(const std::string &rom, const std::string &what) {
+    if (failures++ < 20)
+        std::cerr << rom << ": " << what << std::endl;
+}
+
+/// runs of length instructions, slices end at random points of frames
+static std::vector<Schedule> make_schedules(uint64_t seed, uint64_t length) {
+    Random random(seed);
+    std::vector<Schedule> schedules(variants);
+    for (size_t k = 0; k < variants; k++) {
+        schedules[k].seed = random();
+        schedules[k].timer_ratio = 1 + random() % 16;
+    }
+
+    std::vector<uint16_t> keys(variants, 0);
+    for (uint64_t done = 0; done < length;) {
+        uint32_t count = 1 + random() % 32;
+        for (size_t k = 0; k < variants; k++) {
+            if (random() % 3 == 0)
+                keys[k] = random() & random() & 0xffff;
+            schedules[k].slices.push_back(Slice{ count, keys[k] });
+        }
+        done += count;
+    }
+    return schedules;
+}
+
+static Outcome run(const std::shared_ptr<const RomImage> &image, const Schedule &schedule, Mode mode,
+                   InputLog *log = nullptr) {
+    Cpu cpu;
+    TraceRing ring(256);
+    Debugger watch;
+    cpu.load_program(image);
+    cpu.set_seed(schedule.seed);
+    cpu.set_timer_ratio(schedule.timer_ratio);
+    if (mode != Mode::aot)
+        cpu.set_aot(nullptr);
+    if (mode == Mode::reference)
+        cpu.set_trace(&ring);
+    if (mode == Mode::jit)
+        cpu.set_jit(true);
+    if (mode == Mode::debugger)
+        cpu.set_debugger(&watch);
+    if (log)
+        log->begin(cpu);
+
+    Outcome outcome;
+    try {
+        for (const Slice &slice : schedule.slices) {
+            InputLog::unpack(slice.keys, cpu.get_keys());
+            if (log)
+                log->record(cpu);
+            cpu.run(slice.count);
+        }
+    } catch (const std::runtime_error &e) {
+        outcome.error = e.what();
+    }
+    if (log)
+        log->length = cpu.get_instructions();
+
+    outcome.hash = cpu.state_hash();
+    outcome.instructions = cpu.get_instructions();
+    outcome.reg = cpu.get_registers();
+    cpu.copy_ram(outcome.ram);
+    std::memcpy(outcome.vram, cpu.get_vram(), sizeof(outcome.vram));
+    return outcome;
+}
+
+static std::string describe(const Outcome &outcome) {
+    char text[64];
+    snprintf(text, sizeof(text), "pc %04X after %llu", outcome.reg.pc, (unsigned long long)outcome.instructions);
+    return outcome.error.empty() ? text : text + (", " + outcome.error);
+}
+
+/// replay the input log of a run into a fresh Cpu, it must end the same
+static void check_replay(const std::string &name, const std::shared_ptr<const RomImage> &image,
+                         const InputLog &log, const Outcome &expected) {
+    Cpu cpu;
+    cpu.load_program(image);
+    log.apply(cpu);
+    InputLog replay = log;
+    try {
+        replay.run(cpu, log.length);
+    } catch (const std::runtime_error &e) {
+        fail(name, std::string("replay threw ") + e.what());
+        return;
+    }
+
+    // the run failed on the instruction after the logged ones
+    if (!expected.error.empty()) {
+        std::string error;
+        try {
+            cpu.run(1);
+        } catch (const std::runtime_error &e) {
+            error = e.what();
+        }
+        if (error != expected.error) {
+            fail(name, "replay failed with '" + error + "', recorded '" + expected.error + "'");
+            return;
+        }
+    }
+
+    Outcome got;
+    got.reg = cpu.get_registers();
+    got.instructions = cpu.get_instructions();
+    got.error = expected.error;
+    if (cpu.state_hash() != expected.hash || got.instructions != expected.instructions)
+        fail(name, "replay ended at " + describe(got) + ", recorded " + describe(expected));
+}
+
+/// run every lane of a Lockstep like its schedule, each must end like its
+/// reference run
+static void check_lockstep(const std::string &name, const std::shared_ptr<const RomImage> &image,
+                           const std::vector<Schedule> &schedules, const std::vector<Outcome> &expected) {
+    auto cpus = std::make_unique<Lockstep<variants>>();
+    cpus->load_program(image);
+    for (size_t lane = 0; lane < variants; lane++) {
+        cpus->set_seed(lane, schedules[lane].seed);
+        cpus->set_timer_ratio(lane, schedules[lane].timer_ratio);
+    }
+    for (size_t k = 0; k < schedules[0].slices.size(); k++) {
+        for (size_t lane = 0; lane < variants; lane++) {
+            cpus->set_keys(lane, schedules[lane].slices[k].keys);
+        }
+        cpus->run(schedules[0].slices[k].count);
+    }
+
+    for (size_t lane = 0; lane < variants; lane++) {
+        const Outcome &want = expected[lane];
+        Cpu::Register reg = cpus->get_registers(lane);
+        bool same = reg.pc == want.reg.pc && reg.sp == want.reg.sp && reg.i == want.reg.i &&
+                    !std::memcmp(reg.v, want.reg.v, sizeof(reg.v)) &&
+                    !std::memcmp(cpus->get_ram(lane), want.ram, sizeof(want.ram)) &&
+                    !std::memcmp(cpus->get_vram(lane), want.vram, sizeof(want.vram)) &&
+                    cpus->get_instructions(lane) == want.instructions && cpus->get_error(lane) == want.error;
+        if (!same) {
+            Outcome got;
+            got.reg = reg;
+            got.instructions = cpus->get_instructions(lane);
+            got.error = cpus->get_error(lane);
+            fail(name, "lockstep lane " + std::to_string(lane) + " ended at " + describe(got) + ", reference " +
+                       describe(want));
+        }
+    }
+}
+
+/// run a ROM in every mode, lockstep and replay, returns the reference
+/// outcomes
+static std::vector<Outcome> check(const std::string &name, const std::vector<byte> &program, uint64_t seed,
+                                  uint64_t length) {
+    std::shared_ptr<const RomImage> image = RomImage::create(program.data(), program.size());
+    std::vector<Schedule> schedules = make_schedules(seed, length);
+
+    std::vector<Outcome> expected;
+    for (size_t k = 0; k < variants; k++) {
+        const Schedule &schedule = schedules[k];
+        std::string run_name = name + " run " + std::to_string(k);
+        expected.push_back(run(image, schedule, Mode::reference));
+        const Outcome &want = expected.back();
+
+        for (int mode = Mode::plain; mode < mode_count; mode++) {
+#ifndef CHIP8_JIT
+            if (mode == Mode::jit)
+                continue;
+#endif
+            if (mode == Mode::aot && !image->aot)
+                continue;
+
+            InputLog log;
+            Outcome got = run(image, schedule, Mode(mode), mode == Mode::plain ? &log : nullptr);
+            if (got.hash != want.hash || got.instructions != want.instructions || got.error != want.error) {
+                fail(run_name, std::string(mode_names[mode]) + " ended at " + describe(got) + ", reference " +
+                               describe(want));
+            }
+            if (mode == Mode::plain)
+                check_replay(run_name, image, log, want);
+        }
+    }
+    check_lockstep(name, image, schedules, expected);
+    return expected;
+}
+
+static std::vector<byte> assemble(size_t size, std::initializer_list<std::pair<word, std::vector<word>>> code) {
+    std::vector<byte> program(size);
+    for (const auto &part : code) {
+        size_t at = part.first - RomImage::program_start;
+        for (word opcode : part.second) {
+            program[at++] = opcode >> 8;
+            program[at++] = opcode & 0xff;
+        }
+    }
+    return program;
+}
+
+/// programs that once made modes disagree
+static void check_regressions() {
+    // copied routines entered through BNNN at pc 0x1000 and above: idle
+    // loops, a translated block and a busy wait on the keys. Their bugs
+    // showed only when a slice ended at the right instruction, so each
+    // runs under many schedules
+    std::vector<std::pair<const char *, std::vector<byte>>> high = {
+        { "wait delay at 0x10A0", assemble(0x18, { { 0x200, { 0x60F1, 0x6107, 0x6231, 0x6300, 0x6410, 0x65A0, 0xA0A0,
+                                                              0xF555, 0x6A05, 0xFA15, 0x60A1, 0xBFFF } } }) },
+        { "key loop at 0x10A0", assemble(0x12, { { 0x200, { 0x60E1, 0x619E, 0x6210, 0x63A0, 0xA0A0, 0xF355, 0x6105,
+                                                            0x60A1, 0xBFFF } } }) },
+        { "jump self at 0x10A0", assemble(0x0C, { { 0x200, { 0x6010, 0x61A0, 0xA0A0, 0xF155, 0x60A1, 0xBFFF } } }) },
+        { "block at 0x10A0", assemble(0x22, { { 0x200, { 0x6074, 0x6101, 0x6274, 0x6302, 0x6474, 0x6503, 0x6674,
+                                                         0x6704, 0x6812, 0x6920, 0xA0A0, 0xF955, 0x60A1, 0xBFFF,
+                                                         0x0000, 0x0000, 0x1220 } } }) },
+    };
+    for (const auto &rom : high) {
+        for (uint64_t seed = 0; seed < 64; seed++) {
+            check(std::string(rom.first) + " seed " + std::to_string(seed), rom.second, seed, 500);
+        }
+    }
+
+    // stores through I past 0xFFF rewrite a routine at 0x0A0 and 0x000,
+    // which then returns VA = 2
+    std::vector<std::vector<byte>> wraps = {
+        assemble(0x1C, { { 0x200, { 0x606A, 0x6101, 0x6200, 0x63EE, 0xA0A0, 0xF355, 0x20A0, 0x6102, 0xAFFF,
+                                    0x64A1, 0xF41E, 0xF355, 0x20A0, 0x121A } } }),
+        assemble(0x1E, { { 0x200, { 0x606A, 0x6101, 0x6200, 0x63EE, 0xA000, 0xF355, 0x2000, 0x626A, 0x6302,
+                                    0x6400, 0x65EE, 0xAFFE, 0xF555, 0x2000, 0x121C } } }),
+    };
+    for (size_t k = 0; k < wraps.size(); k++) {
+        std::string name = "wrapping store " + std::to_string(k);
+        for (const Outcome &outcome : check(name, wraps[k], 5 + k, 1000)) {
+            if (outcome.reg.v[0xa] != 2)
+                fail(name, "VA is " + std::to_string(outcome.reg.v[0xa]));
+        }
+    }
+
+    // long enough for the translator to flush its code memory while a
+    // translated block calls a routine that translates more
+    std::vector<word> routine(60, 0x8454);
+    routine.push_back(0x00EE);
+    check("jit flush", assemble(0x27A, { { 0x200, { 0x2300, 0x6300, 0x6200, 0x6080, 0xA400, 0xF055, 0x2400,
+                                                    0x7201, 0x3200, 0x1206, 0x7301, 0x3305, 0x1204, 0x6013,
+                                                    0x6104, 0xA308, 0xF155, 0x2300, 0x1224 } },
+                                         { 0x300, { 0x8454, 0x8454, 0xF107, 0x3100, 0x00EE, 0x00EE } },
+                                         { 0x400, routine } }),
+          7, 2000000);
+}
+
+/// runs generated ROMs in every mode of Cpu, in a Lockstep and replayed
+/// from an input log, and checks they all end in the same state
+int main(int argc, char *argv[]) {
+    uint64_t seeds = argc > 1 ? strtoull(argv[1], nullptr, 0) : 200;
+
+    size_t failed = 0, compiled = 0;
+    for (uint64_t seed = 0; seed < seeds; seed++) {
+        std::vector<byte> program = generate_rom(seed);
+        compiled += RomImage::create(program.data(), program.size())->aot != nullptr;
+        std::string name = "seed " + std::to_string(seed);
+        for (const Outcome &outcome : check(name, program, seed, generated_length)) {
+            failed += !outcome.error.empty();
+        }
+    }
+    check_regressions();
+
+    std::cout << seeds << " generated roms, " << compiled << " compiled, " << failed << " of "
+              << seeds * variants << " runs failed, " << failures << " mismatches" << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,139 @@
+#include "cpu.h"
+#include "env.h"
+#include "random.h"
+#include "rom_gen.h"
+#include "rom_image.h"
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static size_t failures = 0;
+
+static void fail(const std::string &what) {
+    if (failures++ < 20)
+        std::cerr << what << std::endl;
+}
+
+/// observation of a Cpu in the layout of config
+static std::vector<byte> observe(const Cpu &cpu, const VectorEnv::Config &config) {
+    const uint64_t *vram = cpu.get_vram();
+    if (config.observation == VectorEnv::Observation::packed) {
+        std::vector<byte> out(sizeof(uint64_t) * Cpu::vram_height);
+        std::memcpy(out.data(), vram, out.size());
+        return out;
+    }
+    std::vector<byte> out(Cpu::vram_size);
+    for (size_t y = 0; y < Cpu::vram_height; y++) {
+        Cpu::expand_row<byte>(vram[y], out.data() + y * Cpu::vram_width, 1, 0);
+    }
+    return out;
+}
+
+/// one instance as a Cpu, episodes restart like in VectorEnv
+struct Instance {
+    Cpu cpu;
+    uint64_t frames = 0;
+    uint64_t episodes = 0;
+    std::string error;
+
+    void restart(const VectorEnv::Config &config, size_t env) {
+        cpu.set_seed(config.seed + env + episodes * config.count);
+        cpu.reset();
+        frames = 0;
+    }
+};
+
+/// steps a VectorEnv and one Cpu per instance with the same actions,
+/// observations, done flags and episode errors must match
+static void check(uint64_t rom_seed, const VectorEnv::Config &config, size_t steps) {
+    std::string name = "rom " + std::to_string(rom_seed) + ", " + std::to_string(config.count) + " instances";
+    std::vector<byte> program = generate_rom(rom_seed);
+    std::shared_ptr<const RomImage> image = RomImage::create(program.data(), program.size());
+
+    VectorEnv env(image, config);
+    std::vector<std::unique_ptr<Instance>> instances;
+    for (size_t n = 0; n < config.count; n++) {
+        instances.push_back(std::make_unique<Instance>());
+        instances[n]->cpu.set_timer_ratio(config.timer_ratio);
+        instances[n]->cpu.load_program(image);
+        instances[n]->restart(config, n);
+    }
+
+    size_t size = env.observation_size();
+    std::vector<byte> observations(size * config.count);
+    std::vector<byte> done(config.count);
+    std::vector<uint16_t> actions(config.count);
+    Random random(rom_seed);
+
+    env.reset(observations.data());
+    for (size_t step = 0; step <= steps; step++) {
+        for (size_t n = 0; n < config.count; n++) {
+            Instance &instance = *instances[n];
+            bool over = false;
+            if (step > 0) {
+                for (size_t k = 0; k < Cpu::key_size; k++) {
+                    instance.cpu.get_keys()[k] = (actions[n] >> k) & 1;
+                }
+                try {
+                    instance.cpu.run(uint64_t(config.frame_skip) * config.timer_ratio);
+                    instance.error.clear();
+                } catch (const std::runtime_error &e) {
+                    instance.error = e.what();
+                    over = true;
+                }
+                instance.frames += config.frame_skip;
+                over = over || (config.max_frames && instance.frames >= config.max_frames);
+                if (over) {
+                    instance.episodes++;
+                    if (env.get_error(n) != instance.error)
+                        fail(name + ": instance " + std::to_string(n) + " ended with '" + env.get_error(n) +
+                             "', expected '" + instance.error + "'");
+                    instance.restart(config, n);
+                }
+                if (done[n] != over)
+                    fail(name + ": instance " + std::to_string(n) + " done " + std::to_string(done[n]) +
+                         " at step " + std::to_string(step));
+            }
+
+            std::vector<byte> want = observe(instance.cpu, config);
+            if (std::memcmp(observations.data() + n * size, want.data(), size))
+                fail(name + ": instance " + std::to_string(n) + " observation differs at step " +
+                     std::to_string(step));
+            if (env.get_frames(n) != instance.frames || env.get_episodes(n) != instance.episodes)
+                fail(name + ": instance " + std::to_string(n) + " frame or episode count differs at step " +
+                     std::to_string(step));
+        }
+
+        for (size_t n = 0; n < config.count; n++) {
+            actions[n] = random() & random() & 0xffff;
+        }
+        env.step(actions.data(), observations.data(), done.data());
+    }
+}
+
+/// steps generated ROMs through VectorEnv and compares every instance with
+/// a Cpu running it alone
+int main() {
+    VectorEnv::Config config;
+    config.count = 20;
+    config.frame_skip = 3;
+    config.timer_ratio = 7;
+    config.seed = 11;
+    config.max_frames = 60;
+
+    for (uint64_t seed = 0; seed < 16; seed++) {
+        config.observation = seed % 2 ? VectorEnv::Observation::pixels : VectorEnv::Observation::packed;
+        config.threads = seed % 3 ? 1 : 2;
+        check(seed, config, 50);
+    }
+
+    config.count = 3;
+    config.max_frames = 0;
+    check(5, config, 30);
+
+    std::cout << "vector env: " << failures << " mismatches" << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,21 @@
+#include "rom_gen.h"
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+/// writes generated ROMs for chip8_aot, so chip8_test runs them compiled
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        std::cout << "Usage: chip8_test_rom SEED FILE" << std::endl;
+        return 0;
+    }
+
+    std::vector<byte> rom = generate_rom(strtoull(argv[1], nullptr, 0));
+    FILE *out = fopen(argv[2], "wb");
+    if (!out || fwrite(rom.data(), 1, rom.size(), out) != rom.size()) {
+        std::cerr << "could not write rom" << std::endl;
+        return 1;
+    }
+    fclose(out);
+    return 0;
+}
@@ -0,0 +1,46 @@
+#include "input_log.h"
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+static size_t failures = 0;
+
+static void fail(const std::string &what) {
+    if (failures++ < 20)
+        std::cerr << what << std::endl;
+}
+
+/// read text as an input script, error is empty if it must load
+static void check_script(const char *text, const std::string &error, size_t events = 0) {
+    static const char *file = "test_script.txt";
+    FILE *out = fopen(file, "w");
+    if (!out) {
+        fail("could not write input script");
+        return;
+    }
+    fputs(text, out);
+    fclose(out);
+
+    std::string got;
+    try {
+        InputLog log = InputLog::read_script(file, 10);
+        if (log.get_events().size() != events)
+            fail(std::string("script '") + text + "': " + std::to_string(log.get_events().size()) + " events");
+    } catch (const std::runtime_error &e) {
+        got = e.what();
+    }
+    if (got != error)
+        fail(std::string("script '") + text + "': error '" + got + "', expected '" + error + "'");
+    remove(file);
+}
+
+/// input scripts load in frame order and are rejected out of it
+int main() {
+    check_script("0 1\n5 3\n9 0\n", "", 3);
+    check_script("3 1\n3 2\n", "input script frame 3 does not follow frame 3");
+    check_script("0 1\n8 2\n4 0\n", "input script frame 4 does not follow frame 8");
+
+    std::cout << "input log: " << failures << " mismatches" << std::endl;
+    return failures ? 1 : 0;
+}
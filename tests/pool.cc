@@ -0,0 +1,59 @@
+#include "pool.h"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+static size_t failures = 0;
+
+static void fail(const std::string &what) {
+    if (failures++ < 20)
+        std::cerr << what << std::endl;
+}
+
+/// every submitted task runs once before wait returns, in bursts that
+/// find the workers busy and after pauses that find them asleep
+int main() {
+    for (size_t threads : { 1, 2, 4, 8 }) {
+        ThreadPool pool(threads);
+        std::atomic<uint64_t> sum{0};
+        uint64_t expected = 0;
+
+        for (size_t round = 0; round < 200; round++) {
+            size_t tasks = 1 + round % 37;
+            for (size_t k = 0; k < tasks; k++) {
+                uint64_t value = round * 1000 + k;
+                expected += value;
+                pool.submit([&sum, value] { sum += value; });
+            }
+            pool.wait();
+            if (sum != expected) {
+                fail(std::to_string(threads) + " threads: tasks missing after wait in round " + std::to_string(round));
+                break;
+            }
+            if (round % 50 == 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    }
+
+    // tasks submitting tasks
+    {
+        ThreadPool pool(4);
+        std::atomic<size_t> ran{0};
+        for (size_t k = 0; k < 64; k++) {
+            pool.submit([&] {
+                for (size_t n = 0; n < 16; n++) {
+                    pool.submit([&] { ran++; });
+                }
+                ran++;
+            });
+        }
+        pool.wait();
+        if (ran != 64 * 17)
+            fail("nested submits: " + std::to_string(ran) + " tasks ran");
+    }
+
+    std::cout << "thread pool: " << failures << " mismatches" << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,95 @@
+#include "cpu.h"
+#include "profile.h"
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static size_t failures = 0;
+
+static void fail(const std::string &what) {
+    if (failures++ < 20)
+        std::cerr << what << std::endl;
+}
+
+/// what write writes to a file
+template <typename F>
+static std::string capture(F write) {
+    FILE *out = tmpfile();
+    if (!out)
+        return "";
+    write(out);
+    rewind(out);
+    std::string text;
+    for (int c; (c = fgetc(out)) != EOF;) {
+        text += char(c);
+    }
+    fclose(out);
+    return text;
+}
+
+static void check(const std::string &name, const std::string &got, const std::string &expected) {
+    if (got != expected)
+        fail(name + " differs, got:\n" + got + "expected:\n" + expected);
+}
+
+/// report and folded stacks of a loop calling a drawing routine three times
+int main() {
+    std::vector<byte> program = {
+        0x60, 0x03,  // 200 LD V0, 3
+        0x22, 0x0C,  // 202 CALL 20C
+        0x70, 0xFF,  // 204 ADD V0, FF
+        0x30, 0x00,  // 206 SE V0, 0
+        0x12, 0x02,  // 208 JP 202
+        0x12, 0x0A,  // 20A JP 20A, not reached
+        0xA0, 0x00,  // 20C LD I, 0 (font 0, 14 pixels)
+        0xD0, 0x15,  // 20E DRW V0, V1, 5 at x 3, 2 then 1
+        0x00, 0xEE,  // 210 RET
+    };
+    Cpu cpu;
+    Profiler profiler;
+    cpu.load_program(program.data(), program.size());
+    cpu.set_profiler(&profiler);
+    cpu.run(21);
+    if (cpu.get_registers().pc != 0x20A)
+        fail("program did not end at 0x20A");
+
+    check("report", capture([&](FILE *out) { profiler.write_report(out, 4); }),
+          "21 instructions\n"
+          "\n"
+          "opcode                count       %\n"
+          "00EE RET                  3  14.29%\n"
+          "2NNN CALL                 3  14.29%\n"
+          "3XKK SE                   3  14.29%\n"
+          "7XKK ADD                  3  14.29%\n"
+          "ANNN LD I                 3  14.29%\n"
+          "DXYN DRW                  3  14.29%\n"
+          "1NNN JP                   2   9.52%\n"
+          "6XKK LD                   1   4.76%\n"
+          "\n"
+          "address          count       %\n"
+          "0x202                3  14.29%\n"
+          "0x204                3  14.29%\n"
+          "0x206                3  14.29%\n"
+          "0x20C                3  14.29%\n"
+          "\n"
+          "3 draws, 42 pixels drawn, 8 pixels erased in 2 colliding draws\n");
+
+    // calls count in the caller, returns in the callee
+    check("folded stacks", capture([&](FILE *out) { profiler.write_folded(out); }),
+          "main 12\n"
+          "main;sub_0x20C 9\n");
+
+    profiler.clear();
+    check("cleared report", capture([&](FILE *out) { profiler.write_report(out); }),
+          "0 instructions\n"
+          "\n"
+          "opcode                count       %\n"
+          "\n"
+          "address          count       %\n"
+          "\n"
+          "0 draws, 0 pixels drawn, 0 pixels erased in 0 colliding draws\n");
+
+    std::cout << "profile: " << failures << " mismatches" << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,113 @@
+#include "cpu.h"
+#include "random.h"
+#include "rewind.h"
+#include "rom_gen.h"
+#include "rom_image.h"
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static size_t failures = 0;
+
+static void fail(const std::string &what) {
+    if (failures++ < 20)
+        std::cerr << what << std::endl;
+}
+
+/// run a frame with random keys, false if the program failed
+static bool frame(Cpu &cpu, Random &random) {
+    for (size_t k = 0; k < Cpu::key_size; k++) {
+        cpu.get_keys()[k] = (random() & 7) == 0;
+    }
+    try {
+        cpu.run(cpu.get_timer_ratio());
+        return true;
+    } catch (const std::runtime_error &) {
+        return false;
+    }
+}
+
+/// run and push frames, saving their states in history
+static void record(Cpu &cpu, Rewind &rewind, Random &random, size_t frames, std::vector<std::vector<byte>> &history) {
+    for (size_t k = 0; k < frames; k++) {
+        rewind.push(cpu);
+        history.push_back(cpu.save_state());
+        if (!frame(cpu, random))
+            cpu.reset();
+    }
+}
+
+/// step back count frames, each must restore the state saved for it
+static void step_back(const std::string &name, Cpu &cpu, Rewind &rewind, size_t count,
+                      std::vector<std::vector<byte>> &history) {
+    for (size_t k = 0; k < count; k++) {
+        if (!rewind.step_back(cpu)) {
+            fail(name + ": history ended " + std::to_string(count - k) + " frames early");
+            return;
+        }
+        if (cpu.save_state() != history.back())
+            fail(name + ": frame " + std::to_string(history.size() - 1) + " differs");
+        history.pop_back();
+        if (rewind.frames() != history.size())
+            fail(name + ": " + std::to_string(rewind.frames()) + " frames left, expected " +
+                 std::to_string(history.size()));
+    }
+}
+
+/// record past several keyframes, step back across them, record again
+/// from a restored frame and step back to the first frame
+static void check_history(uint64_t seed, uint32_t interval) {
+    std::string name = "rom " + std::to_string(seed) + " interval " + std::to_string(interval);
+    std::vector<byte> program = generate_rom(seed);
+    std::shared_ptr<const RomImage> image = RomImage::create(program.data(), program.size());
+
+    Cpu cpu;
+    cpu.load_program(image);
+    cpu.set_seed(seed);
+    cpu.set_timer_ratio(1 + seed % 16);
+    Random random(seed);
+    Rewind rewind(SIZE_MAX, interval);
+    std::vector<std::vector<byte>> history;
+
+    record(cpu, rewind, random, 2 * interval + interval / 2, history);
+    // back across the last keyframe
+    step_back(name, cpu, rewind, interval, history);
+    record(cpu, rewind, random, interval + 3, history);
+    step_back(name, cpu, rewind, history.size(), history);
+    if (rewind.step_back(cpu) || rewind.frames() != 0 || rewind.memory() != 0)
+        fail(name + ": history left after the first frame");
+}
+
+/// a small budget drops whole segments from the oldest, the kept frames
+/// still restore
+static void check_budget() {
+    std::vector<byte> program = generate_rom(3);
+    std::shared_ptr<const RomImage> image = RomImage::create(program.data(), program.size());
+    Cpu cpu;
+    cpu.load_program(image);
+    Random random(3);
+    Rewind rewind(4 * Cpu::state_size, 16);
+    std::vector<std::vector<byte>> history;
+
+    record(cpu, rewind, random, 200, history);
+    if (rewind.memory() > 4 * Cpu::state_size)
+        fail("budget: " + std::to_string(rewind.memory()) + " bytes used");
+    if (rewind.frames() == 0 || rewind.frames() % 16 != 200 % 16)
+        fail("budget: " + std::to_string(rewind.frames()) + " frames kept");
+    history.erase(history.begin(), history.end() - rewind.frames());
+    step_back("budget", cpu, rewind, history.size(), history);
+}
+
+/// rewinding generated ROMs restores the saved state of every frame
+int main() {
+    for (uint64_t seed = 0; seed < 8; seed++) {
+        check_history(seed, 120);
+        check_history(seed, 1 + seed);
+    }
+    check_budget();
+
+    std::cout << "rewind: " << failures << " mismatches" << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,278 @@
+#include "rom_gen.h"
+#include "random.h"
+#include <stdexcept>
+
+namespace {
+
+/// load address of programs
+constexpr word origin = 0x200;
+/// routines are copied to slots of 8 bytes from here, below the ROM
+constexpr word copy_start = 0x0A0;
+constexpr size_t copy_slots = 12;
+
+/// opcode with an address filled in at layout
+struct Op {
+    enum Fix : byte {
+        /// complete as is
+        none,
+        /// nnn = start of block target
+        block,
+        /// nnn = address of op target of the same block
+        self,
+        /// nnn = address of some patchable op
+        site,
+        /// kk = high / low byte of a jump to block target
+        jump_high,
+        jump_low,
+    };
+
+    word opcode;
+    Fix fix;
+    size_t target;
+    /// plain arithmetic that a patch may replace with other arithmetic
+    bool patchable;
+};
+
+using Block = std::vector<Op>;
+
+class Generator {
+public:
+    explicit Generator(uint64_t seed) : random(seed) {}
+
+    std::vector<byte> generate() {
+        size_t count = 10 + random() % 6;
+        size_t subs = 4;
+        for (size_t b = 0; b < count; b++) {
+            blocks.push_back(main_block(b, count, count, subs));
+        }
+        for (size_t s = 0; s < subs; s++) {
+            blocks.push_back(subroutine());
+        }
+
+        // some programs fail part way
+        if (random() % 6 == 0) {
+            Block &block = blocks[random() % count];
+            word bad = random() % 2 ? 0x8008 : 0x00ee;
+            block.insert(block.begin() + random() % block.size(), Op{ bad, Op::none, 0, false });
+        }
+        return layout();
+    }
+
+private:
+    Random random;
+    std::vector<Block> blocks;
+
+    byte reg() { return random() % 16; }
+
+    Op plain(word opcode) { return Op{ opcode, Op::none, 0, false }; }
+
+    /// arithmetic, timer or I update without memory access or control flow
+    Op arithmetic() {
+        static constexpr byte alu[] = { 0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xe };
+        static constexpr byte misc[] = { 0x07, 0x15, 0x18, 0x1e, 0x29 };
+        word x = reg() << 8, y = reg() << 4;
+        word opcode;
+        switch (random() % 10) {
+            case 0: opcode = 0x6000 | x | (random() & 0xff); break;
+            case 1: case 2: opcode = 0x7000 | x | (random() & 0xff); break;
+            case 3: case 4: case 5: opcode = 0x8000 | x | y | alu[random() % sizeof(alu)]; break;
+            case 6: opcode = 0xa000 | (rom_data_start + random() % 0xf0); break;
+            case 7: opcode = 0xc000 | x | (random() & 0xff); break;
+            default: opcode = 0xf000 | x | misc[random() % sizeof(misc)]; break;
+        }
+        return Op{ opcode, Op::none, 0, true };
+    }
+
+    /// load a valid key number into a register, returns it
+    byte key_reg(Block &block) {
+        byte x = reg();
+        block.push_back(plain(0x6000 | x << 8 | (random() % 16)));
+        return x;
+    }
+
+    void run(Block &block, size_t min, size_t max) {
+        for (size_t n = min + random() % (max - min + 1); n > 0; n--) {
+            block.push_back(arithmetic());
+        }
+    }
+
+    void draw(Block &block) {
+        word sprite = random() % 2 ? random() % 0x50 : rom_data_start + random() % 0xf0;
+        block.push_back(plain(0xa000 | sprite));
+        block.push_back(plain(0xd000 | reg() << 8 | reg() << 4 | (1 + random() % 15)));
+    }
+
+    void memory(Block &block) {
+        static constexpr byte ops[] = { 0x33, 0x55, 0x65 };
+        block.push_back(plain(0xa000 | (rom_data_start + random() % 0xf0)));
+        block.push_back(plain(0xf000 | reg() << 8 | ops[random() % sizeof(ops)]));
+    }
+
+    Block main_block(size_t index, size_t count, size_t first_sub, size_t subs) {
+        Block block;
+        run(block, 2, 8);
+
+        for (size_t features = random() % 3; features > 0; features--) {
+            switch (random() % 12) {
+                case 0: draw(block); break;
+                case 1: memory(block); break;
+                case 2: {
+                    // I runs past 0xFFF, accesses wrap to low memory
+                    static constexpr byte ops[] = { 0x33, 0x55, 0x65 };
+                    byte x = reg();
+                    block.push_back(plain(0xa000 | (0xf80 + random() % 0x80)));
+                    block.push_back(plain(0x6000 | x << 8 | (random() & 0xff)));
+                    block.push_back(plain(0xf01e | x << 8));
+                    block.push_back(plain(0xf000 | reg() << 8 | ops[random() % sizeof(ops)]));
+                    break;
+                }
+                case 3: {
+                    // rewrite arithmetic somewhere in the program
+                    word patch = arithmetic().opcode;
+                    block.push_back(plain(0x6000 | (patch >> 8)));
+                    block.push_back(plain(0x6100 | (patch & 0xff)));
+                    block.push_back(Op{ 0xa000, Op::site, 0, false });
+                    block.push_back(plain(0xf155));
+                    break;
+                }
+                case 4: {
+                    static constexpr word skips[] = { 0x3000, 0x4000, 0x5000, 0x9000 };
+                    word skip = skips[random() % 4];
+                    word operand = (skip == 0x3000 || skip == 0x4000) ? random() & 0xff : reg() << 4;
+                    block.push_back(plain(skip | reg() << 8 | operand));
+                    block.push_back(arithmetic());
+                    break;
+                }
+                case 5: {
+                    byte x = key_reg(block);
+                    block.push_back(plain(0xe000 | x << 8 | (random() % 2 ? 0x9e : 0xa1)));
+                    block.push_back(arithmetic());
+                    break;
+                }
+                case 6: {
+                    // FX07 3X00 1NNN waiting for the delay timer
+                    byte x = reg();
+                    block.push_back(plain(0x6000 | x << 8 | (1 + random() % 3)));
+                    block.push_back(plain(0xf015 | x << 8));
+                    size_t loop = block.size();
+                    block.push_back(plain(0xf007 | x << 8));
+                    block.push_back(plain(0x3000 | x << 8));
+                    block.push_back(Op{ 0x1000, Op::self, loop, false });
+                    break;
+                }
+                case 7: {
+                    // EX9E / EXA1 1NNN waiting for a key change
+                    byte x = key_reg(block);
+                    size_t loop = block.size();
+                    block.push_back(plain(0xe000 | x << 8 | (random() % 2 ? 0x9e : 0xa1)));
+                    block.push_back(Op{ 0x1000, Op::self, loop, false });
+                    break;
+                }
+                case 8:
+                    block.push_back(plain(0xf00a | reg() << 8));
+                    break;
+                case 9: case 10:
+                    block.push_back(Op{ 0x2000, Op::block, first_sub + random() % subs, false });
+                    break;
+                default:
+                    copied(block, (index + 1) % count);
+                    break;
+            }
+        }
+
+        // one in a few hundred blocks ends in a jump to itself
+        if (random() % 300 == 0) {
+            block.push_back(Op{ 0x1000, Op::self, block.size(), false });
+        } else if (index + 1 == count || random() % 2) {
+            block.push_back(Op{ 0x1000, Op::block, random() % count, false });
+        }
+        return block;
+    }
+
+    /// copy four instructions to a slot below 0x200 and jump there through
+    /// BNNN at pc 0x1000 and above, they end in a jump to block back
+    void copied(Block &block, size_t back) {
+        word at = copy_start + 8 * (random() % copy_slots);
+        word code[3];
+        if (random() % 2) {
+            // FX07 3X00 1NNN delay loop at the slot
+            byte x = reg();
+            code[0] = 0xf007 | x << 8;
+            code[1] = 0x3000 | x << 8;
+            code[2] = 0x1000 | at;
+            block.push_back(plain(0x6000 | x << 8 | (1 + random() % 3)));
+            block.push_back(plain(0xf015 | x << 8));
+        } else {
+            for (word &opcode : code) {
+                opcode = arithmetic().opcode;
+            }
+        }
+
+        for (size_t k = 0; k < 3; k++) {
+            block.push_back(plain(0x6000 | (2 * k) << 8 | (code[k] >> 8)));
+            block.push_back(plain(0x6000 | (2 * k + 1) << 8 | (code[k] & 0xff)));
+        }
+        block.push_back(Op{ 0x6600, Op::jump_high, back, false });
+        block.push_back(Op{ 0x6700, Op::jump_low, back, false });
+        block.push_back(plain(0xa000 | at));
+        block.push_back(plain(0xf755));
+        // V0 + NNN = 0x1000 + at
+        block.push_back(plain(0x60ff));
+        block.push_back(plain(0xb000 | (0xf01 + at)));
+    }
+
+    Block subroutine() {
+        Block block;
+        run(block, 2, 6);
+        if (random() % 2)
+            random() % 2 ? draw(block) : memory(block);
+        block.push_back(plain(0x00ee));
+        return block;
+    }
+
+    std::vector<byte> layout() {
+        std::vector<word> starts;
+        std::vector<word> sites;
+        word addr = origin;
+        for (const Block &block : blocks) {
+            starts.push_back(addr);
+            for (const Op &op : block) {
+                if (op.patchable)
+                    sites.push_back(addr);
+                addr += 2;
+            }
+        }
+        if (addr > rom_data_start)
+            throw std::runtime_error("generated program overlaps its data");
+
+        std::vector<byte> rom(rom_data_start + 0x100 - origin);
+        for (size_t b = 0; b < blocks.size(); b++) {
+            for (size_t k = 0; k < blocks[b].size(); k++) {
+                const Op &op = blocks[b][k];
+                word opcode = op.opcode;
+                switch (op.fix) {
+                    case Op::none: break;
+                    case Op::block: opcode |= starts[op.target]; break;
+                    case Op::self: opcode |= starts[b] + 2 * op.target; break;
+                    case Op::site: opcode |= sites[random() % sites.size()]; break;
+                    case Op::jump_high: opcode |= 0x10 | starts[op.target] >> 8; break;
+                    case Op::jump_low: opcode |= starts[op.target] & 0xff; break;
+                }
+                size_t at = starts[b] + 2 * k - origin;
+                rom[at] = opcode >> 8;
+                rom[at + 1] = opcode & 0xff;
+            }
+        }
+
+        for (size_t at = rom_data_start - origin; at < rom.size(); at++) {
+            rom[at] = random() & 0xff;
+        }
+        return rom;
+    }
+};
+
+}
+
+std::vector<byte> generate_rom(uint64_t seed) {
+    return Generator(seed).generate();
+}
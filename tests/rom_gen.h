@@ -0,0 +1,18 @@
+#ifndef CHIP8_TESTS_ROM_GEN_H
+#define CHIP8_TESTS_ROM_GEN_H
+
+#include "common.h"
+#include <vector>
+
+/// first address of the data generated programs load, store and draw
+static constexpr word rom_data_start = 0x700;
+
+/// random well-formed program of seed for differential tests: blocks of
+/// straight-line arithmetic joined by skips, jumps and calls, with draws,
+/// timers, busy wait loops, stores into data and into its own code, stores
+/// through I above 0xFFF, and code copied below 0x200 that runs at pc 0x1000
+/// and above. Some seeds get an invalid opcode or stray return. Equal seeds
+/// give equal programs
+std::vector<byte> generate_rom(uint64_t seed);
+
+#endif
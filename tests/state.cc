@@ -0,0 +1,177 @@
+#include "cpu.h"
+#include "jit.h"
+#include "random.h"
+#include "rom_gen.h"
+#include "rom_image.h"
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/// offsets into a version 2 save state
+static constexpr size_t version_at = 4;
+static constexpr size_t sp_at = 10;
+/// timer ratio, timer countdown, instructions and generator state end it
+static constexpr size_t ratio_from_end = 24;
+static constexpr size_t countdown_from_end = 20;
+
+static size_t failures = 0;
+
+static void fail(const std::string &what) {
+    if (failures++ < 20)
+        std::cerr << what << std::endl;
+}
+
+/// run count instructions with random keys, false if the program failed
+static bool run(Cpu &cpu, Random &random, uint64_t count) {
+    try {
+        for (uint64_t done = 0; done < count; done += 16) {
+            for (size_t k = 0; k < Cpu::key_size; k++) {
+                cpu.get_keys()[k] = (random() & 7) == 0;
+            }
+            cpu.run(16);
+        }
+        return true;
+    } catch (const std::runtime_error &) {
+        return false;
+    }
+}
+
+static void put32(std::vector<byte> &state, size_t from_end, uint32_t value) {
+    std::memcpy(state.data() + state.size() - from_end, &value, sizeof(value));
+}
+
+/// save mid-run, load into a fresh Cpu that ran elsewhere, both must go on
+/// alike; saving again gives the same bytes
+static void check_round_trip(uint64_t seed) {
+    std::string name = "rom " + std::to_string(seed);
+    std::vector<byte> program = generate_rom(seed);
+    std::shared_ptr<const RomImage> image = RomImage::create(program.data(), program.size());
+
+    Cpu cpu;
+    cpu.load_program(image);
+    cpu.set_seed(seed);
+    cpu.set_timer_ratio(1 + seed % 16);
+    Random random(seed);
+    if (!run(cpu, random, 1000 + seed * 37))
+        return;
+    std::vector<byte> state = cpu.save_state();
+
+    // translated and decoded code of the other run must not survive
+    Cpu copy;
+    copy.load_program(image);
+#ifdef CHIP8_JIT
+    copy.set_jit(seed % 2);
+#endif
+    Random other(~seed);
+    run(copy, other, 500);
+    copy.load_state(state);
+
+    if (copy.save_state() != state)
+        fail(name + ": state saved after loading differs");
+    if (copy.state_hash() != cpu.state_hash() || copy.get_instructions() != cpu.get_instructions() ||
+        copy.get_timer_ratio() != cpu.get_timer_ratio())
+        fail(name + ": loaded state differs");
+
+    Random keys(seed + 1), same(seed + 1);
+    bool ran = run(cpu, keys, 2000);
+    if (run(copy, same, 2000) != ran || copy.state_hash() != cpu.state_hash() ||
+        copy.get_instructions() != cpu.get_instructions())
+        fail(name + ": runs differ after loading");
+}
+
+/// cpu must throw error on loading state and be left as it was before
+static void check_rejected(const std::string &name, Cpu &cpu, const std::vector<byte> &state, const char *error) {
+    uint64_t hash = cpu.state_hash();
+    uint64_t instructions = cpu.get_instructions();
+    try {
+        cpu.load_state(state);
+        fail(name + ": accepted");
+        return;
+    } catch (const std::runtime_error &e) {
+        if (e.what() != std::string(error))
+            fail(name + ": rejected with '" + e.what() + "'");
+    }
+    if (cpu.state_hash() != hash || cpu.get_instructions() != instructions)
+        fail(name + ": state changed");
+}
+
+/// cpu must throw on loading a corrupt state and be left as if reset
+static void check_corrupt(const std::string &name, const std::shared_ptr<const RomImage> &image,
+                          const std::vector<byte> &state) {
+    Cpu cpu;
+    cpu.load_program(image);
+    cpu.set_seed(5);
+    cpu.set_timer_ratio(3);
+    Random random(1);
+    run(cpu, random, 300);
+    try {
+        cpu.load_state(state);
+        fail(name + ": accepted");
+        return;
+    } catch (const std::runtime_error &e) {
+        if (e.what() != std::string("corrupt save state"))
+            fail(name + ": rejected with '" + e.what() + "'");
+    }
+
+    Cpu reset;
+    reset.load_program(image);
+    reset.set_seed(5);
+    reset.set_timer_ratio(3);
+    Random keys(2), same(2);
+    run(cpu, keys, 500);
+    run(reset, same, 500);
+    if (cpu.state_hash() != reset.state_hash() || cpu.get_instructions() != reset.get_instructions())
+        fail(name + ": cpu not reset");
+}
+
+static void check_invalid() {
+    std::vector<byte> program = generate_rom(1);
+    std::shared_ptr<const RomImage> image = RomImage::create(program.data(), program.size());
+    Cpu cpu;
+    cpu.load_program(image);
+    Random random(3);
+    run(cpu, random, 700);
+    std::vector<byte> state = cpu.save_state();
+    run(cpu, random, 300);
+
+    std::vector<byte> truncated(state.begin(), state.end() - 1);
+    check_rejected("truncated state", cpu, truncated, "invalid save state size");
+    check_rejected("empty state", cpu, {}, "invalid save state size");
+    std::vector<byte> longer = state;
+    longer.push_back(0);
+    check_rejected("longer state", cpu, longer, "invalid save state size");
+
+    std::vector<byte> magic = state;
+    magic[0] ^= 0xff;
+    check_rejected("bad magic", cpu, magic, "unsupported save state");
+    std::vector<byte> version = state;
+    version[version_at]++;
+    check_rejected("other version", cpu, version, "unsupported save state");
+
+    std::vector<byte> sp = state;
+    sp[sp_at] = Cpu::stack_size + 1;
+    check_corrupt("stack pointer past the stack", image, sp);
+    std::vector<byte> ratio = state;
+    put32(ratio, ratio_from_end, 0);
+    check_corrupt("zero timer ratio", image, ratio);
+    std::vector<byte> countdown = state;
+    put32(countdown, countdown_from_end, 0);
+    check_corrupt("zero timer countdown", image, countdown);
+    put32(countdown, countdown_from_end, Cpu::default_timer_ratio + 1);
+    check_corrupt("timer countdown past the ratio", image, countdown);
+}
+
+/// save states of generated ROMs load back into the same run, states of
+/// the wrong size or version are rejected as is, corrupt ones reset
+int main() {
+    for (uint64_t seed = 0; seed < 32; seed++) {
+        check_round_trip(seed);
+    }
+    check_invalid();
+
+    std::cout << "save state: " << failures << " mismatches" << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,152 @@
+#include "cpu.h"
+#include "random.h"
+#include "rom_gen.h"
+#include "rom_image.h"
+#include "state_hash.h"
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+static size_t failures = 0;
+
+static void fail(const std::string &what) {
+    if (failures++ < 20)
+        std::cerr << what << std::endl;
+}
+
+/// hash of a Cpu holding the state of cpu, every part hashed from scratch
+static uint64_t full_hash(const std::shared_ptr<const RomImage> &image, const Cpu &cpu) {
+    Cpu copy;
+    copy.load_program(image);
+    copy.load_state(cpu.save_state());
+    return copy.state_hash();
+}
+
+/// hash after every slice of a generated ROM, as a search does, must
+/// equal a hash from scratch of the same state
+static void check_incremental(uint64_t seed) {
+    std::string name = "rom " + std::to_string(seed);
+    std::vector<byte> program = generate_rom(seed);
+    std::shared_ptr<const RomImage> image = RomImage::create(program.data(), program.size());
+
+    Cpu cpu, other;
+    cpu.load_program(image);
+    other.load_program(image);
+    Random random(seed);
+    for (size_t slice = 0; slice < 300; slice++) {
+        uint32_t count = 1 + random() % 24;
+        for (size_t k = 0; k < Cpu::key_size; k++) {
+            cpu.get_keys()[k] = other.get_keys()[k] = (random() & 7) == 0;
+        }
+        try {
+            cpu.run(count);
+            other.run(count);
+        } catch (const std::runtime_error &) {
+            return;
+        }
+
+        uint64_t hash = cpu.state_hash();
+        if (hash != full_hash(image, cpu)) {
+            fail(name + ": incremental hash differs after " + std::to_string(cpu.get_instructions()) +
+                 " instructions");
+            return;
+        }
+        // the same state, hashed only now and then
+        if (slice % 7 == 6 && other.state_hash() != hash) {
+            fail(name + ": hash depends on when it was taken");
+            return;
+        }
+    }
+}
+
+/// a page written back to its image contents hashes like the shared page,
+/// a byte changed anywhere changes the hash
+static void check_equal_states() {
+    // store V0 = 0 at 0x300 where the image holds 0, then loop
+    std::vector<byte> program = { 0xA3, 0x00, 0x60, 0x00, 0xF0, 0x55, 0x12, 0x06 };
+    std::shared_ptr<const RomImage> image = RomImage::create(program.data(), program.size());
+    Cpu cpu;
+    cpu.load_program(image);
+    cpu.run(4);
+    uint64_t hash = cpu.state_hash();
+    if (hash != full_hash(image, cpu))
+        fail("page rewritten with its image contents hashes differently");
+
+    std::vector<byte> state = cpu.save_state();
+    Random random(9);
+    for (size_t k = 0; k < 64; k++) {
+        std::vector<byte> changed = state;
+        // one byte of memory or video memory, past the 27 byte header
+        size_t at = 27 + random() % (Cpu::mem_size + Cpu::vram_size / 8);
+        changed[at] ^= 1 << (random() % 8);
+        Cpu copy;
+        copy.load_program(image);
+        copy.load_state(changed);
+        if (copy.state_hash() == hash)
+            fail("changing state byte " + std::to_string(at) + " keeps the hash");
+    }
+}
+
+/// threads insert overlapping ranges, each hash is new to exactly one of
+/// them and every one is found afterwards
+static void check_visited_set() {
+    constexpr size_t threads = 8, per_thread = 20000, distinct = per_thread * 5;
+    VisitedSet set(distinct);
+    std::atomic<size_t> added{0};
+
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            // thread t inserts hashes (t * per_thread / 2 + k) % distinct,
+            // mixed so they spread over the table
+            size_t mine = 0;
+            for (size_t k = 0; k < per_thread; k++) {
+                mine += set.insert(StateHash::mix((t * per_thread / 2 + k) % distinct + 2));
+            }
+            added += mine;
+        });
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+
+    size_t expected = std::min(distinct, (threads - 1) * per_thread / 2 + per_thread);
+    if (added != expected || set.size() != expected)
+        fail("visited set: " + std::to_string(added) + " new, size " + std::to_string(set.size()) + ", expected " +
+             std::to_string(expected));
+    for (size_t k = 0; k < distinct; k++) {
+        bool inserted = k < expected;
+        if (set.contains(StateHash::mix(k + 2)) != inserted) {
+            fail("visited set: hash " + std::to_string(k) + (inserted ? " lost" : " found"));
+            break;
+        }
+    }
+
+    VisitedSet small(2);
+    small.insert(0);
+    if (small.insert(1) || !small.contains(1))
+        fail("visited set: 0 and 1 are not one entry");
+    small.insert(2);
+    try {
+        small.insert(3);
+        fail("visited set: insert past capacity accepted");
+    } catch (const std::runtime_error &) {
+    }
+}
+
+/// incremental state hashes of generated ROMs match hashes from scratch,
+/// and the visited set keeps every hash inserted concurrently
+int main() {
+    for (uint64_t seed = 0; seed < 32; seed++) {
+        check_incremental(seed);
+    }
+    check_equal_states();
+    check_visited_set();
+
+    std::cout << "state hash: " << failures << " mismatches" << std::endl;
+    return failures ? 1 : 0;
+}
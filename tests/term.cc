@@ -0,0 +1,56 @@
+#include "cpu.h"
+#include "term.h"
+#include <iostream>
+#include <string>
+
+static size_t failures = 0;
+
+/// escape sequences as readable text
+static std::string show(const std::string &text) {
+    std::string out;
+    for (char c : text) {
+        out += c == '\x1b' ? std::string("\\e") : std::string(1, c);
+    }
+    return out;
+}
+
+static void check(const std::string &name, const std::string &got, const std::string &expected) {
+    if (got != expected && failures++ < 20)
+        std::cerr << name << " differs, got:\n" << show(got) << "\nexpected:\n" << show(expected) << std::endl;
+}
+
+/// pixel bit of column x
+static uint64_t column(size_t x) {
+    return uint64_t(1) << (Cpu::vram_width - 1 - x);
+}
+
+/// golden output of TermScreen for a first frame and the changes after it
+int main() {
+    TermScreen screen;
+    uint64_t vram[Cpu::vram_height] = {};
+
+    // top only, bottom only and both pixels of a line
+    vram[0] = column(0) | column(2);
+    vram[1] = column(1) | column(2);
+    std::string first = "\x1b[?25l\x1b[2J\x1b[1;1H▀▄█" + std::string(61, ' ');
+    for (size_t line = 2; line <= TermScreen::lines; line++) {
+        first += "\x1b[" + std::to_string(line) + ";1H" + std::string(64, ' ');
+    }
+    check("first frame", screen.update(vram), first);
+    check("unchanged frame", screen.update(vram), "");
+
+    // a one cell gap is rewritten, a cell on another line is moved to
+    vram[0] |= column(10) | column(12);
+    vram[7] |= column(40);
+    check("changed cells", screen.update(vram), "\x1b[1;11H▀ ▀\x1b[4;41H▄");
+
+    // a long gap costs more than a cursor move
+    vram[0] &= ~(column(10) | column(12));
+    vram[0] |= column(30);
+    check("cleared cells", screen.update(vram), "\x1b[1;11H   \x1b[1;31H▀");
+
+    check("finish", TermScreen::finish(), "\x1b[17;1H\x1b[?25h");
+
+    std::cout << "term screen: " << failures << " mismatches" << std::endl;
+    return failures ? 1 : 0;
+}